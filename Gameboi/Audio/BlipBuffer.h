@@ -0,0 +1,219 @@
+// Created by Niklas on 19/10/2026.
+// Class which makes band-limited output samples from changes in amplitude at exact clock times
+// Each change adds a band-limited step (an integrated windowed sinc) to the buffer, so the output has no aliasing
+// and the cost depends on the number of changes, not the number of output samples
+// The kernel is polyphase - one set of taps for each sub-sample position - and is added with AVX2 or SSE4.1 when the
+// cpu running the emulator supports them, or with a plain loop otherwise - the choice is made at run time, so builds
+// without -march flags still use them
+
+#ifndef BlipBuffer_h
+#define BlipBuffer_h
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// The SIMD paths are compiled for their own instruction sets with target attributes, which needs GCC or Clang on x86
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BLIP_BUFFER_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace gb {
+    class blip_buffer {
+    public:
+        // Quality levels, which set the number of output samples each change is spread over - wider kernels cut off
+        // closer to half the sample rate and let less aliasing through, but cost more per change
+        enum quality {LOW = 8, MEDIUM = 16, HIGH = 32};
+        
+        // Number of sub-sample positions a change can be at
+        static const int phase_bits = 6;
+        static const int phases = 1 << phase_bits;
+        
+        // Kernel values are fixed point, with this many fractional bits
+        static const int kernel_bits = 15;
+        
+        // Output samples are the summed amplitude changes multiplied by 2^gain_bits
+        int gain_bits = 0;
+        
+        // Instruction sets the kernel can be added with - every one gives exactly the same samples
+        enum simd_level {SCALAR, SSE4_1, AVX2};
+        
+        // Function to get the best instruction set the cpu running the emulator supports
+        static simd_level best_simd_level(){
+#if defined(BLIP_BUFFER_SIMD)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return AVX2;
+            if (__builtin_cpu_supports("sse4.1"))
+                return SSE4_1;
+#endif
+            return SCALAR;
+        }
+        
+        // Function to choose the instruction set the kernel is added with, eg SCALAR to compare against the plain loop
+        // set_rates chooses the best one, so this is called after it
+        void set_simd_level(simd_level level){
+            // Instruction sets the cpu does not support fall back to the best one it does
+            level = std::min(level, best_simd_level());
+            simd = level;
+            add_kernel = level == AVX2 ? add_kernel_avx2 : level == SSE4_1 ? add_kernel_sse4_1 : add_kernel_scalar;
+        }
+        
+        // Function to get the instruction set the kernel is added with
+        simd_level get_simd_level(){
+            return simd;
+        }
+        
+        // Function to set the clock rate of the changes, the output sample rate, the most samples a frame can make
+        // and the quality
+        void set_rates(double clock_rate, double sample_rate, int max_samples, quality _kernel_quality = MEDIUM){
+            base_factor = sample_rate / clock_rate * 4294967296.0;
+            factor = (uint64_t)(base_factor + 0.5);
+            kernel_width = _kernel_quality;
+            buffer.assign(max_samples + kernel_width + 1, 0);
+            offset = 0;
+            integrator = 0;
+            make_kernel();
+            set_simd_level(best_simd_level());
+        }
+        
+        // Function to make samples slightly faster or slower than the sample rate, eg ratio 1.001 makes 0.1% more
+        // samples - only call this between frames, and not beyond the margin given in max_samples
+        void adjust_rate(double ratio){
+            factor = (uint64_t)(base_factor * ratio + 0.5);
+        }
+        
+        // Function to add a change in amplitude at a clock, counted from the end of the last frame
+        void add_delta(int clock, int delta){
+            uint64_t position = offset + clock * factor;
+            const int32_t* kernel_phase = &kernel[((position >> (32 - phase_bits)) & (phases - 1)) * kernel_width];
+            int32_t* out = &buffer[position >> 32];
+            
+            add_kernel(out, kernel_phase, kernel_width, delta);
+        }
+        
+        // Function to end a frame lasting a number of clocks - samples up to the end of the frame can then be read
+        void end_frame(int clocks){
+            offset += clocks * factor;
+        }
+        
+        // Function to get the number of samples which can be read
+        int samples_available(){
+            return (int)(offset >> 32);
+        }
+        
+        // Function to read up to count samples into out, every stride samples (eg 2 for one side of a stereo buffer)
+        // Returns the number of samples read, which are removed from the buffer
+        int read_samples(int16_t* out, int count, int stride){
+            count = std::min(count, samples_available());
+            
+            for (int i = 0; i < count; i++){
+                integrator += buffer[i];
+                int sample = integrator >> (kernel_bits - gain_bits);
+                out[i * stride] = (int16_t)std::max(-32768, std::min(32767, sample));
+            }
+            
+            // Moves the changes not yet read to the start of the buffer
+            int remaining = samples_available() - count + kernel_width;
+            std::memmove(&buffer[0], &buffer[count], remaining * sizeof(int32_t));
+            std::fill(buffer.begin() + remaining, buffer.begin() + remaining + count, 0);
+            
+            offset -= (uint64_t)count << 32;
+            return count;
+        }
+    
+    private:
+        // Stores the summed changes for each output sample, and the running total of the samples read
+        std::vector<int32_t> buffer;
+        int32_t integrator = 0;
+        
+        // Stores the position of the end of the last frame in samples, in 32.32 fixed point, and the samples per clock
+        uint64_t offset = 0;
+        uint64_t factor = 0;
+        double base_factor = 0;
+        
+        // Stores the band-limited impulse for each sub-sample phase, kernel_width taps each - each sums to exactly
+        // 1 << kernel_bits, so the output always settles at the sum of the changes
+        int kernel_width = MEDIUM;
+        std::vector<int32_t> kernel;
+        
+        // Stores the instruction set the kernel is added with, and the function which adds it
+        simd_level simd = SCALAR;
+        void (*add_kernel)(int32_t*, const int32_t*, int, int) = add_kernel_scalar;
+        
+        // Functions to add a phase of the kernel multiplied by a change to the output samples, for each instruction set
+        static void add_kernel_scalar(int32_t* out, const int32_t* taps, int width, int delta){
+            for (int i = 0; i < width; i++)
+                out[i] += taps[i] * delta;
+        }
+        
+#if defined(BLIP_BUFFER_SIMD)
+        __attribute__((target("sse4.1")))
+        static void add_kernel_sse4_1(int32_t* out, const int32_t* taps, int width, int delta){
+            __m128i deltas = _mm_set1_epi32(delta);
+            for (int i = 0; i < width; i += 4){
+                __m128i kernel_taps = _mm_loadu_si128((const __m128i*)(taps + i));
+                __m128i samples = _mm_loadu_si128((const __m128i*)(out + i));
+                _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(samples, _mm_mullo_epi32(kernel_taps, deltas)));
+            }
+        }
+        
+        __attribute__((target("avx2")))
+        static void add_kernel_avx2(int32_t* out, const int32_t* taps, int width, int delta){
+            __m256i deltas = _mm256_set1_epi32(delta);
+            for (int i = 0; i < width; i += 8){
+                __m256i kernel_taps = _mm256_loadu_si256((const __m256i*)(taps + i));
+                __m256i samples = _mm256_loadu_si256((const __m256i*)(out + i));
+                _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(samples, _mm256_mullo_epi32(kernel_taps, deltas)));
+            }
+        }
+#else
+        // Without SIMD support, every instruction set uses the plain loop (best_simd_level is always SCALAR)
+        static void add_kernel_sse4_1(int32_t* out, const int32_t* taps, int width, int delta){
+            add_kernel_scalar(out, taps, width, delta);
+        }
+        
+        static void add_kernel_avx2(int32_t* out, const int32_t* taps, int width, int delta){
+            add_kernel_scalar(out, taps, width, delta);
+        }
+#endif
+        
+        // Function to make the kernel from a Blackman windowed sinc, cut off below half the sample rate - a wider
+        // kernel has a sharper cut off, so it can be closer
+        void make_kernel(){
+            const double pi = 3.14159265358979323846;
+            const double cutoff = kernel_width == LOW ? 0.4 : kernel_width == MEDIUM ? 0.45 : 0.475;
+            kernel.assign(phases * kernel_width, 0);
+            
+            for (int phase = 0; phase < phases; phase++){
+                int32_t* taps = &kernel[phase * kernel_width];
+                std::vector<double> values(kernel_width);
+                double total = 0;
+                
+                for (int i = 0; i < kernel_width; i++){
+                    double x = i - (kernel_width / 2 - 1) - (double)phase / phases;
+                    double sinc = x == 0 ? 1.0 : std::sin(2 * pi * cutoff * x) / (2 * pi * cutoff * x);
+                    double window = 0.42 + 0.5 * std::cos(2 * pi * x / kernel_width) + 0.08 * std::cos(4 * pi * x / kernel_width);
+                    values[i] = sinc * window;
+                    total += values[i];
+                }
+                
+                // Rounds each value, and puts the rounding error on the largest value
+                int32_t sum = 0;
+                int largest = 0;
+                for (int i = 0; i < kernel_width; i++){
+                    taps[i] = (int32_t)std::lround(values[i] / total * (1 << kernel_bits));
+                    sum += taps[i];
+                    if (taps[i] > taps[largest])
+                        largest = i;
+                }
+                taps[largest] += (1 << kernel_bits) - sum;
+            }
+        }
+    };
+}
+
+#endif /* BlipBuffer_h */
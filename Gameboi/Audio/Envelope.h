@@ -25,8 +25,10 @@ namespace gb {
             // Sets incrementing to bit 3
             incrementing = (reg & 0b00001000) >> 3;
             
-            // Resets ticks to 0
+            // Resets ticks to 0, and starts at the initial volume
             ticks = 0;
+            current_volume = initial_volume;
+            prev_volume = current_volume;
             
             // Sets update flag
             update = true;
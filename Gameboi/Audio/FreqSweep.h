@@ -1,13 +1,78 @@
 // Created by Niklas on 21/04/2020
 // Class to handle frequency sweeping of the first square wave channel
+// The sweep is clocked by the frame sequencer at 128 Hz, and every few clocks moves the frequency up or down by a
+// fraction of itself - if the frequency would go above 2047, the channel is turned off
 
 #ifndef FreqSweep_h
 #define FreqSweep_h
 
+#include <cstdint>
+
 namespace gb {
     class FreqSweep {
     public:
+        // Stores the frequency the sweep works from, which the apu copies to the channel and NR13/NR14 after each change
+        uint16_t frequency = 0;
+        
+        // Flag which signals to the APU that the frequency has overflowed, and the channel should be turned off
+        bool overflowed = false;
+        
+        // Function to load the settings when a new value is written to NR10
+        void reset(uint8_t reg) {
+            // Sets period to bits 6-4, decreasing to bit 3 and shift to bits 2-0
+            period = (reg & 0b01110000) >> 4;
+            decreasing = (reg & 0b00001000) >> 3;
+            shift = reg & 0b00000111;
+        }
+        
+        // Function to restart the sweep from the channel's frequency when it is triggered - if there is a shift, the
+        // next frequency is checked for overflow straight away
+        void trigger(uint16_t _frequency) {
+            frequency = _frequency;
+            timer = period != 0 ? period : 8;
+            enabled = period != 0 or shift != 0;
+            overflowed = shift != 0 and next_frequency() > 2047;
+        }
+        
+        // Function to clock the sweep - returns true if the frequency changed
+        bool count() {
+            if (!enabled or --timer > 0)
+                return false;
+            
+            // A period of 0 reloads the timer with 8, but never changes the frequency
+            timer = period != 0 ? period : 8;
+            if (period == 0)
+                return false;
+            
+            int new_frequency = next_frequency();
+            if (new_frequency > 2047) {
+                overflowed = true;
+                return false;
+            }
+            if (shift == 0)
+                return false;
+            
+            // The new frequency is checked for overflow again, without being used
+            frequency = new_frequency;
+            overflowed = next_frequency() > 2047;
+            return true;
+        }
+    
     private:
+        // Stores the period in sweep clocks, whether the frequency is decreasing, and the shift
+        int period = 0;
+        bool decreasing = false;
+        int shift = 0;
+        
+        // Stores the sweep clocks until the next change, and whether the sweep is running
+        int timer = 8;
+        bool enabled = false;
+        
+        // Function which calculates the next frequency
+        int next_frequency() {
+            int change = frequency >> shift;
+            return decreasing ? frequency - change : frequency + change;
+        }
     };
 }
 
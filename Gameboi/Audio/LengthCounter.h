@@ -0,0 +1,47 @@
+// Created by Niklas on 19/10/2026.
+// Class which controls the length counter of a channel, which turns it off after a set time
+// The counter is clocked by the frame sequencer at 256 Hz, and is loaded from NRx1 - the registers themselves are
+// never changed, as the length bits cannot be read back by games
+
+#ifndef LengthCounter_h
+#define LengthCounter_h
+
+namespace gb {
+    class LengthCounter {
+    public:
+        // Stores whether the counter turns the channel off when it runs out (NRx4 bit 6)
+        bool enabled = false;
+        
+        // Constructor takes the longest length - 64 for the square and noise channels, and 256 for the wave channel
+        LengthCounter(int _max_length = 64) {
+            max_length = _max_length;
+        }
+        
+        // Function to load the counter from the length bits when NRx1 is written
+        void load(int length) {
+            counter = max_length - length;
+        }
+        
+        // Function to reload the counter with the longest length when the channel is triggered, if it has run out
+        void trigger() {
+            if (counter == 0)
+                counter = max_length;
+        }
+        
+        // Function to clock the counter - returns true if it runs out, which turns the channel off
+        bool count() {
+            if (!enabled or counter == 0)
+                return false;
+            
+            counter--;
+            return counter == 0;
+        }
+    
+    private:
+        // Stores the longest length, and the clocks left until the channel is turned off
+        int max_length = 64;
+        int counter = 0;
+    };
+}
+
+#endif /* LengthCounter_h */
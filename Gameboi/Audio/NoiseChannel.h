@@ -1,79 +1,88 @@
 // Created by Niklas on 15/04/2020.
-// Class which inherits from sf::SoundStream and plays audio data for the noise channel
-// Frequency controls etc are handled in the apu
+// Class which generates the output of the noise channel in emulated time
+// Frequency controls etc are handled in the apu, which runs the channel and mixes its output (see apu.h)
 
 #ifndef NoiseChannel_h
 #define NoiseChannel_h
 
-#include <SFML/Audio.hpp>
+#include <cstdint>
 
 namespace gb {
-    class NoiseChannel : public sf::SoundStream {
+    class NoiseChannel {
     public:
         // Stores whether the LFSR is operating in 15 bit mode
         bool mode_15 = true;
         
-        // Function to initialise the stream
-        bool open(int _sample_rate, int channel_count) {
-            sample_rate = _sample_rate;
-            initialize(channel_count, sample_rate);
-        }
-        
-    private:
-        // Stores the samples and sample rate
-        std::vector<sf::Int16> samples;
-        int sample_rate;
+        // Stores the volume (0-15) and whether the channel is playing
+        int volume = 0;
+        bool enabled = false;
         
-        // Stores the 16-bit LFSR
-        uint16_t LFSR = 0xFFFF;
+        // Function to set the frequency from NR43 - the LFSR is shifted every divisor << shift clocks
+        void set_frequency(uint8_t nr43){
+            const int divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+            period = divisors[nr43 & 0b111] << (nr43 >> 4);
+        }
         
-        // Function to get the next sample value
-        sf::Int16 get_next_sample() {
-            // Last bit of LFSR is the output
-            bool output = LFSR & 1;
-            
-            // XORs last two bits of LFSR
-            bool new_bit = ((LFSR & 0b10) >> 1) ^ (LFSR & 0b01);
-            
-            if (mode_15)
-                // If in mode 15, this bit is placed at bit 14
-                LFSR = (LFSR >> 1) | (new_bit << 14);
-            else
-                // Otherwise, this bit is placed in bit 6
-                LFSR = ((LFSR >> 1) & ~(1 << 6)) | (new_bit << 6);
-            
-            // Returns either 32767 or -32768 depending on output bit
-            return output ? -32768 : 32767;
+        // Function to reset the LFSR and restart the frequency timer when the channel is triggered
+        void trigger(){
+            LFSR = 0x7FFF;
+            timer = period;
         }
         
-        // Function to send data when requested
-        virtual bool onGetData(Chunk& data){
-            samples.clear();
-            const int num_samples = 48000;
-            
-            // Sends one second of data
-            for (int i = 0; i < (num_samples / (sample_rate / 1000)); i ++){
-                // Calculates sample value
-                sf::Int16 sample = get_next_sample();
-                
-                //Sends it enough times for a base frequency of 100Hz (modified by changing pitch)
-                for (int j = 0; j < (sample_rate / 1000); j++) {
-                    samples.push_back(sample);
-                }
+        // Function to run the channel for a number of clocks - output_changed(clock, output) is called after each
+        // shift of the LFSR, with the clock counted from the start of the run, so the apu knows exactly when the output changes
+        template <typename callback>
+        void run(int clocks, callback output_changed){
+            if (!enabled) {
+                skip(clocks);
+                return;
             }
             
-            // Fill the chunk with audio data from the stream source
-            data.samples = &samples[0];
-            data.sampleCount = samples.size();
+            int clock = timer;
+            while (clock <= clocks) {
+                shift_LFSR();
+                output_changed(clock, output());
+                clock += period;
+            }
+            timer = clock - clocks;
+        }
+        
+        // Function to run the channel for a number of clocks while it is not playing - the LFSR is reset when the
+        // channel is triggered, so only the timer needs to move on
+        void skip(int clocks){
+            timer -= clocks;
+            if (timer <= 0)
+                timer += (1 - timer / period) * period;
+        }
+        
+        // Function to get the current output, from -volume to volume
+        int output(){
+            if (!enabled)
+                return 0;
             
-            // Return true to continue playing
-            return true;
+            // The output is high when bit 0 of the LFSR is 0
+            return (LFSR & 1) ? -volume : volume;
         }
+    
+    private:
+        // Stores the 15-bit LFSR
+        uint16_t LFSR = 0x7FFF;
         
-        // Unimplementnted
-        virtual void onSeek(sf::Time timeOffset){}
+        // Stores the clocks per shift of the LFSR, and the clocks left until the next shift
+        int period = 8;
+        int timer = 8;
+        
+        // Function to shift the LFSR once
+        void shift_LFSR() {
+            // XORs last two bits of LFSR
+            uint16_t new_bit = (LFSR ^ (LFSR >> 1)) & 1;
+            
+            // The new bit is placed at bit 14, and also at bit 6 in 7 bit mode
+            LFSR = (LFSR >> 1) | (new_bit << 14);
+            if (!mode_15)
+                LFSR = (LFSR & ~(1 << 6)) | (new_bit << 6);
+        }
     };
 }
 
-
 #endif /* NoiseChannel_h */
@@ -1,24 +1,70 @@
 // Created by Niklas on 16/04/2020.
-// Class which inherits from sf::SoundStream and plays audio data for the square wave channels
-// Frequency controls etc are handled in the apu
+// Class which generates the output of the square wave channels in emulated time
+// Frequency controls etc are handled in the apu, which runs the channel and mixes its output (see apu.h)
 
 #ifndef SquareChannel_h
 #define SquareChannel_h
 
-#include <SFML/Audio.hpp>
+#include <cstdint>
 
 namespace gb {
-    class SquareChannel : public sf::SoundStream {
+    class SquareChannel {
     public:
-        // Function to initialise the stream
-        bool open(int _sample_rate, int channel_count) {
-            sample_rate = _sample_rate;
-            initialize(channel_count, sample_rate);
+        // Stores which duty cycle is being used (0-3)
+        int duty_cycle = 2;
+        
+        // Stores the volume (0-15) and whether the channel is playing
+        int volume = 0;
+        bool enabled = false;
+        
+        // Function to set the frequency from the 11 bit value in NRx3 and NRx4 - each of the 8 steps of the wave
+        // lasts (2048 - frequency) * 4 clocks
+        void set_frequency(uint16_t frequency){
+            period = (2048 - frequency) * 4;
         }
         
-        // Stores which duty cycle is being used (1-4)
-        int duty_cycle = 2;
+        // Function to restart the frequency timer when the channel is triggered
+        void trigger(){
+            timer = period;
+        }
+        
+        // Function to run the channel for a number of clocks - output_changed(clock, output) is called after each
+        // step of the wave, with the clock counted from the start of the run, so the apu knows exactly when the output changes
+        template <typename callback>
+        void run(int clocks, callback output_changed){
+            if (!enabled or volume == 0) {
+                skip(clocks);
+                return;
+            }
+            
+            int clock = timer;
+            while (clock <= clocks) {
+                wave_cycle = (wave_cycle + 1) % 8;
+                output_changed(clock, output());
+                clock += period;
+            }
+            timer = clock - clocks;
+        }
+        
+        // Function to run the channel for a number of clocks while it is silent - the wave moves on without
+        // visiting each step
+        void skip(int clocks){
+            timer -= clocks;
+            if (timer <= 0) {
+                int steps = 1 - timer / period;
+                timer += steps * period;
+                wave_cycle = (wave_cycle + steps) % 8;
+            }
+        }
         
+        // Function to get the current output, from -volume to volume
+        int output(){
+            if (!enabled)
+                return 0;
+            
+            return wave_patterns[duty_cycle][wave_cycle] ? volume : -volume;
+        }
+    
     private:
         // Stores the wave patterns
         const bool wave_patterns[4][8] = {
@@ -28,50 +74,12 @@ namespace gb {
             {1, 1, 1, 1, 1, 1, 0, 0}
         };
         
-        // Stores the samples and sample rate
-        std::vector<sf::Int16> samples;
-        int sample_rate;
-        
         // Stores which part of the wave is being used
         int wave_cycle = 0;
         
-        // Function to get the next sample value
-        sf::Int16 get_next_sample() {
-            // Gets current cycle
-            bool high = wave_patterns[duty_cycle][wave_cycle];
-            
-            // Incrments cycle value
-            wave_cycle = (wave_cycle + 1) % 8;
-            
-            // Returns correct sample
-            return high ? 32767 : -32768;
-        }
-        
-        // Function to send data when requested
-        virtual bool onGetData(Chunk& data){
-            samples.clear();
-            const int num_samples = 12000;
-            
-            for (int i = 0; i < (num_samples / (sample_rate / 800)); i ++){
-                // Calculates sample value
-                sf::Int16 sample = get_next_sample();
-                
-                // Sends it enough times for a base frequency of 100Hz (modified by changing pitch)
-                for (int j = 0; j < (sample_rate / 800); j++) {
-                    samples.push_back(sample);
-                }
-            }
-            
-            // Fill the chunk with audio data from the stream source
-            data.samples = &samples[0];
-            data.sampleCount = samples.size();
-            
-            // Return true to continue playing
-            return true;
-        }
-        
-        // Unimplementnted
-        virtual void onSeek(sf::Time timeOffset){}
+        // Stores the clocks per step of the wave, and the clocks left until the next step
+        int period = 8192;
+        int timer = 8192;
     };
 }
 
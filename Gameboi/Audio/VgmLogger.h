@@ -0,0 +1,167 @@
+// Created by Niklas on 19/10/2026.
+// Class which records the writes to the sound registers as a VGM file (version 1.61, which supports the Game Boy's
+// DMG sound), for debugging the apu and archiving game music
+// Each write becomes a wait since the last one, in samples at 44100 Hz, and a Game Boy register write command - these
+// are added to a preallocated block which is written to disk in batches on a writer thread (see BlockWriter.h)
+// The apu only calls the logger when one is connected, so logging costs nothing when it is off
+
+#ifndef VgmLogger_h
+#define VgmLogger_h
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#include "BlockWriter.h"
+
+namespace gb {
+    class vgm_logger {
+    public:
+        // Constructor takes the path of the file to write, which is created when logging starts
+        vgm_logger(std::string _path){
+            path = _path;
+        }
+        
+        // Destructor finishes writing the file
+        ~vgm_logger(){
+            stop();
+        }
+        
+        // Function to open the file and start the writer thread - times in the file are counted from the master clock
+        // logging starts at
+        void start(uint64_t clock){
+            stop();
+            start_clock = clock;
+            samples_written = 0;
+            data_bytes = 0;
+            writes_logged = 0;
+            
+            file = std::fopen(path.c_str(), "wb");
+            opened = file != nullptr;
+            if (!file)
+                return;
+            
+            // The header's sizes are filled in when the file is finished
+            write_header();
+            writer.start(file);
+        }
+        
+        // Function to log a write to a sound register (FF10 - FF3F) made at a master clock
+        void log_write(uint64_t clock, uint8_t reg, uint8_t value){
+            if (!writer.is_running())
+                return;
+            
+            wait_until(clock);
+            
+            // Command B3 writes a value to a Game Boy sound register, counted from FF10
+            const uint8_t command[3] = {0xB3, (uint8_t)(reg - 0x10), value};
+            add_data(command, 3);
+            writes_logged++;
+        }
+        
+        // Function to finish the file, after waiting up to the master clock logging stops at
+        void stop(uint64_t clock = 0){
+            if (!writer.is_running())
+                return;
+            
+            wait_until(clock);
+            const uint8_t end_of_data = 0x66;
+            add_data(&end_of_data, 1);
+            
+            writer.stop();
+            std::fseek(file, 0, SEEK_SET);
+            write_header();
+            std::fclose(file);
+            file = nullptr;
+        }
+        
+        // Function to check whether the file could be opened when logging started
+        bool was_opened(){
+            return opened;
+        }
+        
+        // Function to get the number of writes logged
+        size_t get_writes_logged(){
+            return writes_logged;
+        }
+    
+    private:
+        // Stores the file's path, and the file while it is open
+        std::string path;
+        FILE* file = nullptr;
+        bool opened = false;
+        
+        // Stores the master clock logging started at, the samples waited so far, the bytes of commands written and the
+        // number of writes logged
+        uint64_t start_clock = 0;
+        uint64_t samples_written = 0;
+        uint32_t data_bytes = 0;
+        size_t writes_logged = 0;
+        
+        // Number of clocks the gameboy runs per second, and the sample rate all VGM waits are counted in
+        static const uint32_t clock_speed = 4194304;
+        static const uint32_t vgm_sample_rate = 44100;
+        
+        // Size of the header, which the commands follow
+        static const uint32_t header_bytes = 0x100;
+        
+        // Writes the commands on its own thread, in blocks of 64 kB (about 20000 writes)
+        gb::block_writer<uint8_t> writer{65536};
+        
+        // Function to add commands to the file
+        void add_data(const uint8_t* data, size_t count){
+            writer.push(data, count);
+            data_bytes += count;
+        }
+        
+        // Function to add wait commands up to the sample a master clock falls in
+        void wait_until(uint64_t clock){
+            uint64_t samples = clock > start_clock ? (clock - start_clock) * vgm_sample_rate / clock_speed : 0;
+            if (samples <= samples_written)
+                return;
+            
+            uint64_t wait = samples - samples_written;
+            samples_written = samples;
+            
+            // Commands 62 and 63 wait for a 60 Hz and 50 Hz frame, 70 - 7F wait for 1 - 16 samples, and 61 waits for
+            // any number of samples up to 65535
+            while (wait > 0) {
+                if (wait == 735 or wait == 882) {
+                    const uint8_t command = wait == 735 ? 0x62 : 0x63;
+                    add_data(&command, 1);
+                    wait = 0;
+                } else if (wait <= 16) {
+                    const uint8_t command = 0x70 + (uint8_t)(wait - 1);
+                    add_data(&command, 1);
+                    wait = 0;
+                } else {
+                    uint16_t count = wait < 65535 ? (uint16_t)wait : 65535;
+                    const uint8_t command[3] = {0x61, (uint8_t)(count & 0xFF), (uint8_t)(count >> 8)};
+                    add_data(command, 3);
+                    wait -= count;
+                }
+            }
+        }
+        
+        // Function to write the 256 byte header, with the sizes of the commands written so far
+        void write_header(){
+            uint8_t header[header_bytes] = {'V', 'g', 'm', ' '};
+            auto set_32 = [&header](int offset, uint32_t value){
+                for (int i = 0; i < 4; i++)
+                    header[offset + i] = (value >> (8 * i)) & 0xFF;
+            };
+            
+            // Offset of the end of the file, version, total samples, offset of the commands (counted from 0x34) and
+            // the Game Boy's clock - all other chips are unused
+            set_32(0x04, header_bytes + data_bytes - 0x04);
+            set_32(0x08, 0x161);
+            set_32(0x18, (uint32_t)samples_written);
+            set_32(0x34, header_bytes - 0x34);
+            set_32(0x80, clock_speed);
+            
+            std::fwrite(header, 1, header_bytes, file);
+        }
+    };
+}
+
+#endif /* VgmLogger_h */
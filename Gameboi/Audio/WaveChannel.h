@@ -1,97 +1,90 @@
 // Created by Niklas on 21/04/2020.
-// Class which inherits from sf::SoundStream and plays audio data for the wave channel
-// Frequency controls etc are handled in the apu
+// Class which generates the output of the wave channel in emulated time
+// Frequency controls etc are handled in the apu, which runs the channel and mixes its output (see apu.h)
+// The wave pattern RAM is copied when the channel is triggered, so playing it never reads the registers
 
 #ifndef WaveChannel_h
 #define WaveChannel_h
 
-#include <SFML/Audio.hpp>
-#include "bus.h"
+#include <cstdint>
 
 namespace gb {
-    class WaveChannel : public sf::SoundStream {
+    class WaveChannel {
     public:
-        // Function to initialise the stream
-        bool open(int _sample_rate, int channel_count, gb::bus* _bus) {
-            bus = _bus;
-            sample_rate = _sample_rate;
-            initialize(channel_count, sample_rate);
-        }
-        
-        // Stores a pointer to the bus
-        gb::bus* bus;
-        
-        // Stores the wave sample data
-        uint8_t wave_samples[32];
-        
-        // Stores the volume setting
+        // Stores the volume setting from NR32 bits 6-5 (0 = mute, 1 = 100%, 2 = 50%, 3 = 25%)
         int volume = 1;
         
-    private:
-        // Stores the samples and sample rate
-        std::vector<sf::Int16> samples;
-        int sample_rate;
+        // Stores whether the channel is playing
+        bool enabled = false;
         
-        // Stores which part of the wave is being used
-        int wave_cycle = 0;
+        // Function to set the frequency from the 11 bit value in NR33 and NR34 - each of the 32 samples
+        // lasts (2048 - frequency) * 2 clocks
+        void set_frequency(uint16_t frequency){
+            period = (2048 - frequency) * 2;
+        }
         
-        // Function to get fetch the wave sample data from the bus
-        void read_wave_samples() {
-            for (int i = 0; i < 0x10; i++) {
-                // Reads raw data from FF30 + i
-                uint8_t raw_data = bus->read(0xFF30 + i);
-                
-                // Stores high nybble then low nybble
-                wave_samples[2 * i + 0] = raw_data >> 4;
-                wave_samples[2 * i + 1] = raw_data & 0x0F;
-            }
+        // Function to restart the wave from its first sample when the channel is triggered, with the contents of
+        // the wave pattern RAM (FF30 - FF3F) at that time
+        void trigger(const uint8_t* pattern){
+            for (int i = 0; i < 16; i++)
+                wave_ram[i] = pattern[i];
             
+            wave_cycle = 0;
+            timer = period;
         }
         
-        // Function to get the next sample value
-        sf::Int16 get_next_sample() {
-            // If volume is 0, returns 0
-            if (volume == 0) return 0;
-            
-            // Gets the appropriate sample
-            int8_t sample_raw = wave_samples[wave_cycle];
-            sample_raw >>= (volume - 1);
-            
-            // Increments cycle counter
-            wave_cycle = (wave_cycle + 1) % 32;
+        // Function to run the channel for a number of clocks - output_changed(clock, output) is called after each
+        // sample of the wave, with the clock counted from the start of the run, so the apu knows exactly when the output changes
+        template <typename callback>
+        void run(int clocks, callback output_changed){
+            if (!enabled or volume == 0) {
+                skip(clocks);
+                return;
+            }
             
-            // Returns the scaled sample
-            return (sample_raw - 8) * 4096;
+            int clock = timer;
+            while (clock <= clocks) {
+                wave_cycle = (wave_cycle + 1) % 32;
+                output_changed(clock, output());
+                clock += period;
+            }
+            timer = clock - clocks;
         }
         
-        // Function to send data when requested
-        virtual bool onGetData(Chunk& data){
-            samples.clear();
-            const int num_samples = 3000;
-            
-            // Reads samples from the bus
-            read_wave_samples();
-            
-            for (int i = 0; i < (num_samples / (sample_rate / 3200)); i ++){
-                // Calculates sample value
-                sf::Int16 sample = get_next_sample();
-                
-                // Sends it enough times for a base frequency of 100Hz (modified by changing pitch)
-                for (int j = 0; j < (sample_rate / 3200); j++) {
-                    samples.push_back(sample);
-                }
+        // Function to run the channel for a number of clocks while it is silent - the wave moves on without
+        // visiting each step
+        void skip(int clocks){
+            timer -= clocks;
+            if (timer <= 0) {
+                int steps = 1 - timer / period;
+                timer += steps * period;
+                wave_cycle = (wave_cycle + steps) % 32;
             }
+        }
+        
+        // Function to get the current output, from -15 to 15 at full volume
+        int output(){
+            if (!enabled or volume == 0)
+                return 0;
             
-            // Fill the chunk with audio data from the stream source
-            data.samples = &samples[0];
-            data.sampleCount = samples.size();
+            // Samples are stored two to a byte, high nybble first
+            uint8_t raw_data = wave_ram[wave_cycle / 2];
+            int sample = (wave_cycle % 2 == 0) ? raw_data >> 4 : raw_data & 0x0F;
             
-            // Return true to continue playing
-            return true;
+            // Centres the sample around 0, and shifts it right for lower volumes
+            return (2 * sample - 15) / (1 << (volume - 1));
         }
+    
+    private:
+        // Stores the wave pattern RAM as it was when the channel was triggered
+        uint8_t wave_ram[16] = {};
+        
+        // Stores which part of the wave is being used
+        int wave_cycle = 0;
         
-        // Unimplementnted
-        virtual void onSeek(sf::Time timeOffset){}
+        // Stores the clocks per sample, and the clocks left until the next sample
+        int period = 4096;
+        int timer = 4096;
     };
 }
 
@@ -1,12 +1,20 @@
 // Created by Niklas on 15/04/2020.
 // Class which handles plaing the gameboy's audio
+// The channels are run in emulated time, and each change in their outputs is added to band-limited left and right
+// buffers (see BlipBuffer.h) at the exact clock it happens - the buffers make a stereo stream at sample_rate, which is
+// played through an audio sink given by the frontend (see Sinks.h) - without one the apu is silent
+// The apu only does work when a sound register is written or the 512 Hz frame sequencer steps - between these
+// events, run just counts clocks - length counters, the frequency sweep and envelopes are all clocked by the frame
+// sequencer, so they also cost nothing in between
+// The bus logs each write to a sound register with the master clock it was made at, so changes land at their exact
+// position in the output even if the apu is run less often than once per instruction
 
 #ifndef apu_h
 #define apu_h
 
-#include <SFML/Audio.hpp>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 
 #include "RegNames.h"
@@ -15,9 +23,13 @@
 
 #include "Envelope.h"
 #include "FreqSweep.h"
+#include "LengthCounter.h"
 #include "NoiseChannel.h"
 #include "WaveChannel.h"
 #include "SquareChannel.h"
+#include "BlipBuffer.h"
+#include "Sinks.h"
+#include "VgmLogger.h"
 
 #define SAMPLE_RATE 44100
 #define TWO_PI 6.28318
@@ -35,6 +47,23 @@ namespace gb {
         gb::Envelope square_wave_1_env;
         gb::Envelope square_wave_2_env;
         gb::Envelope noise_env;
+        
+        // Length counters for each channel, and the frequency sweep of square wave 1
+        gb::LengthCounter square_wave_1_length;
+        gb::LengthCounter square_wave_2_length;
+        gb::LengthCounter wave_length = gb::LengthCounter(256);
+        gb::LengthCounter noise_length;
+        gb::FreqSweep square_wave_1_sweep;
+        
+        // Stores the output sample rate and the quality of the band-limited synthesis, which can be changed
+        // (eg to 48000 or HIGH) before init
+        int sample_rate = SAMPLE_RATE;
+        gb::blip_buffer::quality synthesis_quality = gb::blip_buffer::MEDIUM;
+        
+        // If false, the channels are not synthesised or mixed and no samples are made, eg for headless runs without
+        // sound - the state games can read (length counters and NR52's channel bits) is still kept exactly
+        // Can be changed at any time
+        bool synthesis = true;
 
         // Constructor
         apu(){}
@@ -46,277 +75,531 @@ namespace gb {
         void connect_bus(gb::bus* _bus){
             bus = _bus;
         }
+        
+        // Function to store a pointer to the audio sink which plays the mixed samples - must be called before init
+        void connect_audio(gb::audio_sink* _audio){
+            audio = _audio;
+        }
+        
+        // Function to store a pointer to a started VGM logger which records every write to the sound registers, or
+        // nullptr to stop recording - the current registers are logged first, so the file starts from the apu's state
+        // (channels already playing are not restarted, so logging is best started before the sound is)
+        void connect_vgm_logger(gb::vgm_logger* _vgm_logger){
+            vgm_logger = _vgm_logger;
+            if (!vgm_logger)
+                return;
+            
+            // NR52 is logged first, since the other registers can only be written while the sound is on
+            vgm_logger->log_write(bus->clock, gb::regNames::NR52, get_reg(gb::regNames::NR52));
+            for (uint8_t reg = gb::regNames::WAV0; reg < gb::regNames::NR10 + sound_registers; reg++)
+                vgm_logger->log_write(bus->clock, reg, get_reg(reg));
+            for (uint8_t reg = gb::regNames::NR10; reg < gb::regNames::NR52; reg++)
+                vgm_logger->log_write(bus->clock, reg, get_reg(reg));
+        }
 
         // Function to initialise the apu
         void init() {
-            square_wave_1.open(SAMPLE_RATE, 1);
-            square_wave_1.setLoop(true);
-            square_wave_1.play();
-            
-            square_wave_2.open(SAMPLE_RATE, 1);
-            square_wave_2.setLoop(true);
-            square_wave_2.play();
-            
-            wave_channel.open(SAMPLE_RATE, 1, bus);
-            wave_channel.setLoop(true);
-            //wave_channel.setPitch(10.0);
-            wave_channel.play();
+            // Copies the sound registers, which the apu then keeps up to date from the write log
+            for (int i = 0; i < sound_registers; i++)
+                registers[i] = bus->get_ioreg(gb::regNames::NR10 + i);
+            
+            // Sets up the output buffers - amplitudes are scaled so 4 channels at full volume fit in 16 bits
+            int max_samples = (int)((double)clocks_per_frame * sample_rate / clock_speed * (1 + max_rate_change)) + 2;
+            for (gb::blip_buffer* buffer: {&left_buffer, &right_buffer}) {
+                buffer->set_rates(clock_speed, sample_rate, max_samples, synthesis_quality);
+                buffer->gain_bits = 6;
+            }
             
-            noise_channel.open(SAMPLE_RATE, 1);
-            noise_channel.setLoop(true);
-            noise_channel.play();
+            // Starts the audio output
+            if (audio)
+                audio->start(sample_rate);
             
             // Update all sound devices to load initial settings
             update_all();
         }
         
-        // Function to stop all sounds
-        void stop_all() {
-            square_wave_1.stop();
-            square_wave_2.stop();
-            wave_channel.stop();
-            noise_channel.stop();
+        // Function to get the audio sink, or nullptr if there is none
+        gb::audio_sink* get_audio(){
+            return audio;
         }
         
-        // Function to run every cycle
-        void do_cycle() {
-            // Increment timers
-            cycles_since_length_decrement += 4;
-            cycles_since_envelope += 4;
-            
-            // Reset envelopes if flags are set
-            if (bus->update_square1_envelope) {
-                square_wave_1_env.reset(get_reg(gb::regNames::NR12));
-                bus->update_square1_envelope = false;
-            }
-            if (bus->update_square2_envelope) {
-                square_wave_2_env.reset(get_reg(gb::regNames::NR22));
-                bus->update_square2_envelope = false;
-            }
-            if (bus->update_noise_envelope) {
-                noise_env.reset(get_reg(gb::regNames::NR42));
-                bus->update_noise_envelope = false;
-            }
-            
-            // If 16384 cycles have elapsed, decrement length counters
-            if (cycles_since_length_decrement >= 16384) {
-                decrement_length_counters();
-                cycles_since_length_decrement = 0;
-            }
-            
-            // If 65536 cycles have elapsed, update envelopes
-            if (cycles_since_envelope >= 65536) {
-                update_envelopes();
-                cycles_since_envelope = 0;
+        // Function to stop all sounds, after sending the audio sink the samples not yet sent
+        void stop_all() {
+            if (audio) {
+                if (!sample_buffer.empty())
+                    audio->push_samples(sample_buffer.data(), sample_buffer.size() / 2);
+                audio->stop();
             }
-            
-            // Updates the volumes for each channel
-            update_all_volumes();
-            
-            // If sound registers have been changed...
-            if (bus->update_apu) {
-                // Update all settings
-                update_all();
+            sample_buffer.clear();
+        }
+        
+        // Function to run the apu for a number of clocks, usually after each instruction - handles the logged writes
+        // to sound registers at the clocks they were made, and steps the frame sequencer each time a frame passes
+        // The bus's clock must already have been run up to the end of these clocks - writes logged outside them, eg
+        // when the bus is not being run, are handled at the nearest end
+        void run(int clocks) {
+            int run_clocks = 0;
+            
+            if (!bus->apu_write_log.empty()) {
+                int64_t start = (int64_t)bus->clock - clocks;
                 
-                // Reset update flag
-                bus->update_apu = false;
+                for (const gb::apu_write& write: bus->apu_write_log) {
+                    int offset = (int)std::min<int64_t>(std::max<int64_t>((int64_t)write.clock - start, run_clocks), clocks);
+                    advance(offset - run_clocks);
+                    run_clocks = offset;
+                    handle_write(write);
+                }
+                bus->apu_write_log.clear();
             }
+            
+            advance(clocks - run_clocks);
         }
-        
+    
     private:
         // Stores a pointer to the bus
         gb::bus* bus;
+        
+        // Stores a pointer to the audio sink, or nullptr if there is none
+        gb::audio_sink* audio = nullptr;
+        
+        // Stores a pointer to the VGM logger, or nullptr if writes are not being recorded
+        gb::vgm_logger* vgm_logger = nullptr;
 
-        // Initialises SFML sound objects for each of the sound channels
+        // Objects which generate the output of each of the sound channels
         gb::SquareChannel square_wave_1;
         gb::SquareChannel square_wave_2;
         gb::WaveChannel wave_channel;
         gb::NoiseChannel noise_channel;
+        
+        // Stores the sound registers (FF10 - FF3F) as they are at the apu's current clock - while the write log is
+        // handled, the bus's registers may already hold later writes
+        static const int sound_registers = 0x30;
+        uint8_t registers[sound_registers] = {};
+        
+        // Number of clocks the gameboy runs per second
+        static const int clock_speed = 4194304;
+        
+        // Band-limited buffers for the left and right outputs, which make samples for a frame of clocks at a time
+        gb::blip_buffer left_buffer;
+        gb::blip_buffer right_buffer;
+        static const int clocks_per_frame = 8192;
+        
+        // The most the sample rate is changed by to keep the audio sink's queue half full
+        static constexpr double max_rate_change = 0.005;
+        
+        // Stores the clock in the current frame, and the clock the channels have been run up to
+        int frame_clock = 0;
+        int run_clock = 0;
+        
+        // Stores the output of each channel (square 1, square 2, wave, noise), and what it adds to each side
+        // with the panning and master volume from NR51 and NR50
+        int channel_outputs[4] = {};
+        int channel_left[4] = {};
+        int channel_right[4] = {};
+        uint8_t panning = 0;
+        int left_volume = 1;
+        int right_volume = 1;
+        
+        // Stores mixed stereo samples (left then right) until they are sent to the audio sink
+        static const int samples_per_push = 512;
+        std::vector<int16_t> sample_buffer;
 
-        // Stores the number of cycles since decrementing the various length counters
-        long cycles_since_length_decrement = 0;
-        long cycles_since_envelope = 0;
+        // Stores the step of the frame sequencer (0-7) - length counters are decremented on even steps (256 Hz),
+        // the frequency sweep is clocked on steps 2 and 6 (128 Hz), and envelopes are updated on step 7 (64 Hz)
+        int sequencer_step = 0;
+        
+        // Stores whether NR52 bit 7 was set when it was last handled
+        bool powered_on = false;
         
-        // Stores a table of wave channel volume tables
-        const double wave_channel_volumes[4] = {0.0, 100.0, 50.0, 25.0};
-   
         // Keeps track of the number of updates (for debug/optimisation)
         long num_updates = 0;
         
-        // Function to update the audio settings after the APU register contents change
+        // Function to load all audio settings from the APU registers, eg when the apu is initialised or turned on
+        // If NR52 bit 7 is 0, all sound is muted instead
         void update_all() {
-            num_updates++;
-            // DEBUG: std::cout << "UPDATE " << num_updates << std::endl;
+            run_channels();
+            powered_on = (get_reg(gb::regNames::NR52) & 0x80) != 0;
             
-            // If NR52 bit 7 is 0, mute all sound and return
-            if ((get_reg(gb::regNames::NR52) & 0x80) == 0) {
+            if (powered_on) {
+                for (uint8_t reg = gb::regNames::NR10; reg < gb::regNames::NR52; reg++)
+                    write_register(reg);
+            } else {
                 square_wave_1_playing = false;
                 square_wave_2_playing = false;
+                wave_playing = false;
                 noise_playing = false;
-                update_all_volumes();
-                return;
             }
             
-            // Update square wave channels
-            update_square_channels();
-            
-            // Update wave channel
-            update_wave_channel();
-            
-            // Update noise channel
-            update_noise_channel();
-            
-            // Update all volumes
             update_all_volumes();
+            update_mixer();
+            update_status();
         }
         
+        // Function to move the current clock on, ending the buffers' frame and stepping the frame sequencer each time
+        // a frame (8192 clocks at 512 Hz) passes
+        void advance(int clocks) {
+            frame_clock += clocks;
+            
+            while (frame_clock >= clocks_per_frame) {
+                int clocks_after_frame = frame_clock - clocks_per_frame;
+                frame_clock = clocks_per_frame;
+                end_frame();
+                step_frame_sequencer();
+                frame_clock = clocks_after_frame;
+            }
+        }
         
-        // Function to update all volumes
-        void update_all_volumes() {
-            if (square_wave_1_env.update)
-                update_volume(square_wave_1, square_wave_1_env, square_wave_1_playing);
-            if (square_wave_2_env.update)
-                update_volume(square_wave_2, square_wave_2_env, square_wave_2_playing);
-            if (noise_env.update)
-                update_volume(noise_channel, noise_env, noise_playing);
+        // Function to handle a logged write at the current clock, after running the channels up to it with their old
+        // settings - the value is copied to the bus too, since the apu may have changed the bus's register while
+        // handling an earlier write
+        void handle_write(const gb::apu_write& write) {
+            if (vgm_logger)
+                vgm_logger->log_write(write.clock, write.reg, write.value);
+            
+            run_channels();
+            set_reg(write.reg, write.value);
+            write_register(write.reg);
             
-            // Update wave channel volume
+            update_all_volumes();
+            update_mixer();
+            update_status();
         }
         
-        // Function to update square wave channels
-        void update_square_channels() {
-            // If a 1 is written to the highest bit of NR14, this bit is reset and square wave 1 is enabled
-            if ((get_reg(gb::regNames::NR14) & 0x80) != 0) {
-                write(0xFF00 + gb::regNames::NR14, get_reg(gb::regNames::NR14) & 0x7F);
-                square_wave_1_playing = true;
+        // Function to update the settings which depend on an APU register after it is written
+        void write_register(uint8_t reg) {
+            num_updates++;
+            
+            // NR52 bit 7 turns all sound on and off, loading all settings again when it turns on - while it is off,
+            // the other registers are ignored
+            if (reg == gb::regNames::NR52) {
+                if (((get_reg(gb::regNames::NR52) & 0x80) != 0) != powered_on)
+                    update_all();
+                return;
+            }
+            if (!powered_on)
+                return;
+            
+            switch (reg) {
+                // Square wave 1
+                case gb::regNames::NR10:
+                    square_wave_1_sweep.reset(get_reg(gb::regNames::NR10));
+                    break;
+                case gb::regNames::NR11:
+                    square_wave_1.duty_cycle = (get_reg(gb::regNames::NR11) & 0b11000000) >> 6;
+                    square_wave_1_length.load(get_reg(gb::regNames::NR11) & 0b00111111);
+                    break;
+                case gb::regNames::NR12:
+                    square_wave_1_env.reset(get_reg(gb::regNames::NR12));
+                    check_dac(square_wave_1_playing, gb::regNames::NR12);
+                    break;
+                case gb::regNames::NR13:
+                case gb::regNames::NR14:
+                    update_square_channel(square_wave_1, square_wave_1_env, square_wave_1_length, square_wave_1_playing,
+                                          gb::regNames::NR12, gb::regNames::NR13, gb::regNames::NR14, &square_wave_1_sweep);
+                    break;
+                
+                // Square wave 2
+                case gb::regNames::NR21:
+                    square_wave_2.duty_cycle = (get_reg(gb::regNames::NR21) & 0b11000000) >> 6;
+                    square_wave_2_length.load(get_reg(gb::regNames::NR21) & 0b00111111);
+                    break;
+                case gb::regNames::NR22:
+                    square_wave_2_env.reset(get_reg(gb::regNames::NR22));
+                    check_dac(square_wave_2_playing, gb::regNames::NR22);
+                    break;
+                case gb::regNames::NR23:
+                case gb::regNames::NR24:
+                    update_square_channel(square_wave_2, square_wave_2_env, square_wave_2_length, square_wave_2_playing,
+                                          gb::regNames::NR22, gb::regNames::NR23, gb::regNames::NR24);
+                    break;
+                
+                // Wave channel
+                case gb::regNames::NR31:
+                    wave_length.load(get_reg(gb::regNames::NR31));
+                    break;
+                case gb::regNames::NR30:
+                case gb::regNames::NR32:
+                case gb::regNames::NR33:
+                case gb::regNames::NR34:
+                    update_wave_channel();
+                    break;
                 
+                // Noise channel
+                case gb::regNames::NR41:
+                    noise_length.load(get_reg(gb::regNames::NR41) & 0b00111111);
+                    break;
+                case gb::regNames::NR42:
+                    noise_env.reset(get_reg(gb::regNames::NR42));
+                    check_dac(noise_playing, gb::regNames::NR42);
+                    break;
+                case gb::regNames::NR43:
+                case gb::regNames::NR44:
+                    update_noise_channel();
+                    break;
+                
+                // NR50 and NR51 are read by update_mixer, and wave RAM is copied by the wave channel when it is
+                // triggered
+                default:
+                    break;
+            }
+        }
+        
+        // Function to set the channel status bits in NR52 (bit 0 - 3 = square 1, square 2, wave, noise playing)
+        // Bits 4 - 6 are unused, and always read as 1
+        void update_status() {
+            uint8_t status = (square_wave_1_playing << 0) | (square_wave_2_playing << 1) | (wave_playing << 2) | (noise_playing << 3);
+            set_reg(gb::regNames::NR52, (get_reg(gb::regNames::NR52) & 0x80) | 0x70 | status);
+        }
+        
+        // Function to run all channels up to the current clock, recording each change in their outputs
+        void run_channels() {
+            if (!synthesis) {
+                run_clock = frame_clock;
+                return;
             }
             
-            // If a 1 is written to the highest bit of NR24, this bit is reset and square wave 2 is enabled
-            if ((get_reg(gb::regNames::NR24) & 0x80) != 0) {
-                write(0xFF00 + gb::regNames::NR24, get_reg(gb::regNames::NR24) & 0x7F);
-                square_wave_2_playing = true;
+            int clocks = frame_clock - run_clock;
+            square_wave_1.run(clocks, [this](int clock, int output){ set_channel_output(0, run_clock + clock, output); });
+            square_wave_2.run(clocks, [this](int clock, int output){ set_channel_output(1, run_clock + clock, output); });
+            wave_channel.run(clocks, [this](int clock, int output){ set_channel_output(2, run_clock + clock, output); });
+            noise_channel.run(clocks, [this](int clock, int output){ set_channel_output(3, run_clock + clock, output); });
+            run_clock = frame_clock;
+        }
+        
+        // Function to set a channel's output at a clock in the current frame - if this changes what the channel adds to
+        // either side, the change is added to that side's buffer
+        void set_channel_output(int channel, int clock, int output) {
+            channel_outputs[channel] = output;
+            
+            // NR51 bits 7-4 send each channel to the left output, and bits 3-0 to the right output
+            int left = (panning & (0x10 << channel)) ? output * left_volume : 0;
+            int right = (panning & (0x01 << channel)) ? output * right_volume : 0;
+            
+            if (left != channel_left[channel]) {
+                left_buffer.add_delta(clock, left - channel_left[channel]);
+                channel_left[channel] = left;
             }
+            if (right != channel_right[channel]) {
+                right_buffer.add_delta(clock, right - channel_right[channel]);
+                channel_right[channel] = right;
+            }
+        }
+        
+        // Function to update the panning and master volume, and the outputs of all channels after their settings change
+        // The channels must already have been run up to the current clock
+        void update_mixer() {
+            if (!synthesis)
+                return;
             
-            // If length counter in NR11 is 0, and bit 6 of NR 14 is 1, square wave 1 is disabled
-            if ((get_reg(gb::regNames::NR11) & 0b00111111) == 0 and gb::Utils::get_bit(get_reg(gb::regNames::NR14), 6)) {
-                square_wave_1_playing = false;
-                bus->update_square1_envelope = true;
+            // NR50 bits 6-4 and 2-0 set the left and right volumes (1-8)
+            uint8_t master_volume = get_reg(gb::regNames::NR50);
+            panning = get_reg(gb::regNames::NR51);
+            left_volume = ((master_volume >> 4) & 0b111) + 1;
+            right_volume = (master_volume & 0b111) + 1;
+            
+            set_channel_output(0, frame_clock, square_wave_1.output());
+            set_channel_output(1, frame_clock, square_wave_2.output());
+            set_channel_output(2, frame_clock, wave_channel.output());
+            set_channel_output(3, frame_clock, noise_channel.output());
+        }
+        
+        // Function to end the buffers' frame at the current clock, and send the finished samples to the audio sink
+        void end_frame() {
+            if (!synthesis) {
+                frame_clock = 0;
+                run_clock = 0;
+                return;
             }
             
-            // If length counter in NR21 is 0, and bit 6 of NR 24 is 1, square wave 1 is disabled
-            if ((get_reg(gb::regNames::NR21) & 0b00111111) == 0 and gb::Utils::get_bit(get_reg(gb::regNames::NR24), 6)){
-                square_wave_2_playing = false;
-                bus->update_square2_envelope = true;
+            run_channels();
+            left_buffer.end_frame(frame_clock);
+            right_buffer.end_frame(frame_clock);
+            frame_clock = 0;
+            run_clock = 0;
+            
+            // Reads the samples into the sample buffer, interleaving the left and right sides
+            int count = left_buffer.samples_available();
+            size_t start = sample_buffer.size();
+            sample_buffer.resize(start + 2 * count);
+            left_buffer.read_samples(&sample_buffer[start], count, 2);
+            right_buffer.read_samples(&sample_buffer[start + 1], count, 2);
+            
+            if ((int)sample_buffer.size() >= 2 * samples_per_push) {
+                if (audio) {
+                    audio->push_samples(sample_buffer.data(), sample_buffer.size() / 2);
+                    adjust_rate(audio->fill_level());
+                }
+                sample_buffer.clear();
             }
+        }
+        
+        // Function to adjust the sample rate from the fill level of the audio sink's queue - more samples are made when
+        // it is less than half full and fewer when it is more, so the host's audio and emulation clocks drifting apart
+        // never empties or overflows it
+        void adjust_rate(double fill_level) {
+            if (fill_level < 0)
+                return;
             
-            // Sets the duty cycles
-            square_wave_1.duty_cycle = (get_reg(gb::regNames::NR11) & 0b11000000) >> 6;
-            square_wave_2.duty_cycle = (get_reg(gb::regNames::NR21) & 0b11000000) >> 6;
+            double ratio = 1 + max_rate_change * (1 - 2 * std::min(fill_level, 1.0));
+            left_buffer.adjust_rate(ratio);
+            right_buffer.adjust_rate(ratio);
+        }
+        
+        // Function to step the frame sequencer, at the start of a frame
+        void step_frame_sequencer() {
+            if (sequencer_step % 2 == 0)
+                decrement_length_counters();
+            
+            if (sequencer_step == 2 or sequencer_step == 6)
+                update_sweep();
+            
+            if (sequencer_step == 7)
+                update_envelopes();
             
-            // Sets the frequencies
-            uint16_t square_wave_1_freq_raw = ((get_reg(gb::regNames::NR14) & 0b111) << 8) | get_reg(gb::regNames::NR13);
-            double square_wave_1_freq = 131072.0 / (2048.0 - square_wave_1_freq_raw);
-            square_wave_1.setPitch(square_wave_1_freq / 100.0);
+            sequencer_step = (sequencer_step + 1) % 8;
             
-            uint16_t square_wave_2_freq_raw = ((get_reg(gb::regNames::NR24) & 0b111) << 8) | get_reg(gb::regNames::NR23);
-            double square_wave_2_freq = 131072.0 / (2048.0 - square_wave_2_freq_raw);
-            square_wave_2.setPitch(square_wave_2_freq / 100.0);
+            update_all_volumes();
+            update_mixer();
+            update_status();
+        }
+        
+        // Function to update all volumes, and silence the channels which have stopped playing
+        void update_all_volumes() {
+            square_wave_1.enabled = square_wave_1_playing;
+            square_wave_2.enabled = square_wave_2_playing;
+            wave_channel.enabled = wave_playing;
+            noise_channel.enabled = noise_playing;
+            
+            if (square_wave_1_env.update)
+                update_volume(square_wave_1, square_wave_1_env, square_wave_1_playing);
+            if (square_wave_2_env.update)
+                update_volume(square_wave_2, square_wave_2_env, square_wave_2_playing);
+            if (noise_env.update)
+                update_volume(noise_channel, noise_env, noise_playing);
+        }
+        
+        // Function to update a square wave channel after its frequency (NRx3 or NRx4) is written - square wave 1
+        // also passes its frequency sweep
+        void update_square_channel(gb::SquareChannel& channel, gb::Envelope& envelope, gb::LengthCounter& length,
+                                   bool& playing, uint8_t envelope_reg, uint8_t frequency_reg, uint8_t control_reg,
+                                   gb::FreqSweep* sweep = nullptr) {
+            // Sets the frequency
+            uint16_t frequency = ((get_reg(control_reg) & 0b111) << 8) | get_reg(frequency_reg);
+            channel.set_frequency(frequency);
+            
+            // Bit 6 of NRx4 lets the length counter turn the channel off
+            length.enabled = gb::Utils::get_bit(get_reg(control_reg), 6);
+            
+            // If a 1 is written to the highest bit of NRx4, this bit is reset and the channel is enabled, with its
+            // envelope, length counter and sweep restarted - the sweep can turn the channel straight off again
+            if ((get_reg(control_reg) & 0x80) != 0) {
+                set_reg(control_reg, get_reg(control_reg) & 0x7F);
+                playing = true;
+                channel.trigger();
+                envelope.reset(get_reg(envelope_reg));
+                length.trigger();
+                check_dac(playing, envelope_reg);
+                
+                if (sweep) {
+                    sweep->trigger(frequency);
+                    if (sweep->overflowed)
+                        playing = false;
+                }
+            }
         }
         
         // Update wave channel
         void update_wave_channel() {
+            // Sets the frequency, which the first sample of a triggered wave is played at
+            wave_channel.set_frequency(((get_reg(gb::regNames::NR34) & 0b111) << 8) | get_reg(gb::regNames::NR33));
+            
+            // Bit 6 of NR34 lets the length counter turn the channel off
+            wave_length.enabled = gb::Utils::get_bit(get_reg(gb::regNames::NR34), 6);
+            
             // If a 1 is written to the highest bit of NR34, this bit is reset and wave channel is enabled
             if ((get_reg(gb::regNames::NR34) & 0x80) != 0) {
-                write(0xFF00 + gb::regNames::NR34, get_reg(gb::regNames::NR34) & 0x7F);
+                set_reg(gb::regNames::NR34, get_reg(gb::regNames::NR34) & 0x7F);
                 wave_playing = true;
+                wave_channel.trigger(&registers[gb::regNames::WAV0 - gb::regNames::NR10]);
+                wave_length.trigger();
             }
             
-            // Updates volume
-            int channel_volume_raw = (get_reg(gb::regNames::NR32) & 0b01100000) >> 5;
-            double channel_volume = wave_channel_volumes[channel_volume_raw];
-            
-            wave_channel.setVolume(wave_playing ? channel_volume : 0.0);
-            
-            // Sets wave volume to 0 if disabled
-            if (gb::Utils::get_bit(get_reg(gb::regNames::NR30), 7) == 0)
-                wave_channel.setVolume(0);
-            
             // Sets the shift volume value to bits 6-5 of NR32
+            wave_channel.volume = (get_reg(gb::regNames::NR32) & 0b01100000) >> 5;
             
-            // Sets the frequency
-            uint16_t wave_freq_raw = ((get_reg(gb::regNames::NR34) & 0b111) << 8) | get_reg(gb::regNames::NR33);
-            double wave_freq = 65536.0 / (2048.0 - wave_freq_raw);
-            wave_channel.setPitch(wave_freq / 100.0);
+            // The channel is turned off when its DAC is, by NR30 bit 7
+            if (!gb::Utils::get_bit(get_reg(gb::regNames::NR30), 7))
+                wave_playing = false;
         }
         
         // Update noise channels
         void update_noise_channel() {
-            // If a 1 is written to the highest bit of NR44, this bit is reset and noise is enabled
-            if ((get_reg(gb::regNames::NR44) & 0x80) != 0) {
-                write(0xFF00 + gb::regNames::NR44, get_reg(gb::regNames::NR44) & 0x7F);
-                noise_playing = true;
-            }
-            
-            // If length counter in NR41 is 0, and bit 6 of NR 44 is 1, noise is disabled
-            if ((get_reg(gb::regNames::NR41) & 0b00111111) == 0 and gb::Utils::get_bit(get_reg(gb::regNames::NR44), 6))
-                noise_playing = false;
-            
             // Sets the frequency
-            uint8_t s = (get_reg(gb::regNames::NR43) & 0b11110000) >> 4;
-            uint8_t r_raw = get_reg(gb::regNames::NR43) & 0b00000111;
-            double r = (r_raw == 0) ? 0.5 : (double)r_raw;
-            
-            double noise_freq = 524288.0 / (r * (double)(2 << (s + 1)));
-            noise_channel.setPitch(noise_freq / 1000.0);
+            noise_channel.set_frequency(get_reg(gb::regNames::NR43));
             
             // Sets the LFSR width
             noise_channel.mode_15 = !gb::Utils::get_bit(get_reg(gb::regNames::NR43), 3);
+            
+            // Bit 6 of NR44 lets the length counter turn the channel off
+            noise_length.enabled = gb::Utils::get_bit(get_reg(gb::regNames::NR44), 6);
+            
+            // If a 1 is written to the highest bit of NR44, this bit is reset and noise is enabled, with its
+            // envelope and length counter restarted
+            if ((get_reg(gb::regNames::NR44) & 0x80) != 0) {
+                set_reg(gb::regNames::NR44, get_reg(gb::regNames::NR44) & 0x7F);
+                noise_playing = true;
+                noise_channel.trigger();
+                noise_env.reset(get_reg(gb::regNames::NR42));
+                noise_length.trigger();
+                check_dac(noise_playing, gb::regNames::NR42);
+            }
+        }
+        
+        // Function to turn a channel off if its DAC is, which happens when the upper 5 bits of its envelope register
+        // (NRx2) are all 0
+        void check_dac(bool& playing, uint8_t envelope_reg) {
+            if ((get_reg(envelope_reg) & 0b11111000) == 0)
+                playing = false;
         }
-
         
         // Functions to update the volume of each channel
-        void update_volume(sf::SoundStream& channel, gb::Envelope& envelope, bool playing) {
+        template <typename channel_type>
+        void update_volume(channel_type& channel, gb::Envelope& envelope, bool playing) {
             // Reset update flag
             envelope.update = false;
             
-            // If the channel is not playing, set its volume to 0
-            if (!playing)
-                channel.setVolume(0.0);
-            else
-                // Othwerise, use envelope calculation
-                channel.setVolume(envelope.get_scaled_volume());
+            // If the channel is not playing, it is silent - othwerise, use envelope calculation
+            channel.enabled = playing;
+            channel.volume = envelope.current_volume;
         }
         
-        // Function to decrement the note length counters
+        // Function to decrement the note length counters, turning off the channels whose counters run out
         void decrement_length_counters() {
-            // Decrements lower 6 bits of NR11 by 1
-            uint8_t pulse_1_length = get_reg(gb::regNames::NR11) & 0b00111111;
-            if (pulse_1_length > 0) {
-                pulse_1_length--;
-                write(0xFF00 + gb::regNames::NR11, (get_reg(gb::regNames::NR11) & 0b11000000) | pulse_1_length);
-            }
-
-            // Decrements lower 6 bits of NR21 by 1
-            uint8_t pulse_2_length = get_reg(gb::regNames::NR21) & 0b00111111;
-            if (pulse_2_length > 0) {
-                pulse_2_length--;
-                write(0xFF00 + gb::regNames::NR21, (get_reg(gb::regNames::NR21) & 0b11000000) | pulse_2_length);
-            }
+            if (square_wave_1_length.count())
+                square_wave_1_playing = false;
+            if (square_wave_2_length.count())
+                square_wave_2_playing = false;
+            if (wave_length.count())
+                wave_playing = false;
+            if (noise_length.count())
+                noise_playing = false;
+        }
+        
+        // Function to clock the frequency sweep of square wave 1, copying each new frequency to the channel and
+        // NR13/NR14, and turning the channel off if the frequency overflows
+        void update_sweep() {
+            if (!square_wave_1_playing)
+                return;
             
-            // Decrements NR31 by 1
-            uint8_t wave_length = get_reg(gb::regNames::NR31);
-            if (wave_length > 0) {
-                wave_length--;
-                write(0xFF00 + gb::regNames::NR21, (get_reg(gb::regNames::NR21) & 0b11000000) | wave_length);
+            if (square_wave_1_sweep.count()) {
+                uint16_t frequency = square_wave_1_sweep.frequency;
+                set_reg(gb::regNames::NR13, frequency & 0xFF);
+                set_reg(gb::regNames::NR14, (get_reg(gb::regNames::NR14) & 0b11111000) | (frequency >> 8));
+                square_wave_1.set_frequency(frequency);
             }
             
-            // Decrements lower 6 bits of NR41 by 1
-            uint8_t noise_length = get_reg(gb::regNames::NR41) & 0b00111111;
-            if (noise_length > 0) {
-                noise_length--;
-                write(0xFF00 + gb::regNames::NR41, (get_reg(gb::regNames::NR41) & 0b11000000) | noise_length);
-            }
+            if (square_wave_1_sweep.overflowed)
+                square_wave_1_playing = false;
         }
         
         // Function to increment the square wave envelope counters
@@ -328,7 +611,7 @@ namespace gb {
             if (noise_playing)
                 noise_env.count();
         }
-                
+        
         // Basic functions to read from/write to the bus
         uint8_t read(uint16_t addr){
             return bus->read(addr);
@@ -338,11 +621,18 @@ namespace gb {
             bus->write(addr, data);
         }
         
-        // Function to get the contents of an io register (faste than reading)
+        // Function to get the contents of a sound register at the apu's current clock
         uint8_t get_reg(uint8_t reg_name){
-            return bus->get_ioreg(reg_name);
+            return registers[reg_name - gb::regNames::NR10];
         }
-
+        
+        // Function to set a sound register, and the bus's copy without the bus logging it as written, for the apu's
+        // own changes
+        void set_reg(uint8_t reg_name, uint8_t data){
+            registers[reg_name - gb::regNames::NR10] = data;
+            bus->set_ioreg(reg_name, data);
+        }
+    
     };
 }
 
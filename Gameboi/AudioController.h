@@ -0,0 +1,79 @@
+// Created by Niklas on 19/10/2026.
+// Class which plays the apu's mixed output through one SFML sound stream
+// The samples are made by the apu on the emulation thread, and handed to SFML's thread through a lock-free queue
+// (see Sinks.h) - the apu keeps the queue half full by adjusting its sample rate slightly
+
+#ifndef AudioController_h
+#define AudioController_h
+
+#include <SFML/Audio.hpp>
+#include <vector>
+
+#include "Sinks.h"
+#include "SPSCQueue.h"
+
+class AudioController : public sf::SoundStream, public gb::audio_sink {
+public:
+    // Destructor stops the stream first, since SFML requests data from its own thread
+    ~AudioController(){
+        sf::SoundStream::stop();
+    }
+    
+    // Function to start playing the stream
+    virtual void start(int sample_rate){
+        initialize(2, sample_rate);
+        play();
+    }
+    
+    // Function to queue samples from the emulation thread - if the queue is full, eg when fast forwarding, the
+    // newest samples are dropped
+    virtual void push_samples(const int16_t* samples, size_t count){
+        queue.push(samples, 2 * count);
+    }
+    
+    // Function to get how full the queue is
+    virtual double fill_level(){
+        return (double)queue.size() / queue_capacity;
+    }
+    
+    // Function to stop all sounds
+    virtual void stop(){
+        sf::SoundStream::stop();
+    }
+
+private:
+    // Stores the samples sent by the emulation thread and not yet played (left then right) - 8192 samples is
+    // about 90 ms at 44100 Hz, so about 45 ms of audio is queued when it is half full
+    static const size_t queue_capacity = 8192;
+    gb::spsc_queue<int16_t, queue_capacity> queue;
+    
+    // Stores the samples being played
+    std::vector<int16_t> samples;
+    
+    // Function to send data when requested - plays a short silence if the emulation has not made any samples yet
+    // Samples are always pushed and popped in pairs, so the left and right sides never swap
+    virtual bool onGetData(Chunk& data){
+        const size_t max_chunk_samples = 2 * 1024;
+        const size_t silence_samples = 2 * 256;
+        
+        samples.resize(max_chunk_samples);
+        size_t count = queue.pop(&samples[0], max_chunk_samples);
+        
+        if (count > 0)
+            samples.resize(count);
+        else
+            samples.assign(silence_samples, 0);
+        
+        // Fill the chunk with audio data from the stream source
+        data.samples = &samples[0];
+        data.sampleCount = samples.size();
+        
+        // Return true to continue playing
+        return true;
+    }
+    
+    // Unimplementnted
+    virtual void onSeek(sf::Time timeOffset){}
+};
+
+#endif /* AudioController_h */
@@ -0,0 +1,157 @@
+// Created by Niklas on 19/10/2026.
+// Benchmark which emulates roms as fast as possible and prints the emulation speed as JSON, to track it across builds
+// Reports emulated frames per second, guest instructions per second (MIPS), host ns per frame, the number of bus reads
+// and writes, and the share of the time taken by the cpu, the ppu, the bus and the apu - the bus share is the bus's own
+// cycles plus every read and write made through it (see SubsystemProfile.h)
+// The speed is measured without profiling - unless --no-profile is given, each rom then runs again with a profile
+// timing a sample of instructions, which only gives the shares
+// --no-audio runs the apu without synthesising sound, to compare with the cost of full synthesis
+// Run from the repository folder:
+// emulation_benchmark <frames> <rom name> [rom name ...] [--input <file>] [--no-profile] [--no-audio]
+// The input file is replayed for every rom (see InputReplay.h)
+// Built as the emulation_benchmark target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -pthread -I. -IAudio -IBusDevices -IMappers Benchmarks/emulation_benchmark.cpp instructions.cpp
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+#include "EmulationController.h"
+#include "Sinks.h"
+#include "InputReplay.h"
+#include "SubsystemProfile.h"
+
+// Stores the outcome of running a rom once
+struct PassResult {
+    double seconds = 0;
+    long long instructions = 0;
+    long long cycles = 0;
+    unsigned long long bus_reads = 0;
+    unsigned long long bus_writes = 0;
+    uint64_t last_hash = 0;
+};
+
+// Function to write a string as a quoted JSON string, escaping quotes, backslashes and control characters
+std::string json_string(const std::string& text){
+    std::ostringstream output;
+    output << '"';
+    for (unsigned char c: text) {
+        if (c == '"' or c == '\\')
+            output << '\\' << c;
+        else if (c < 0x20)
+            output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+        else
+            output << c;
+    }
+    output << '"';
+    return output.str();
+}
+
+// Function to run a rom for a number of frames, with a profile if one is given
+PassResult run_pass(std::string rom_name, int frames, gb::input_replay* replay, gb::subsystem_profile* profile, bool audio){
+    gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
+    apu.synthesis = audio;
+    EmulationController emulator(&cpu, &bus, &ppu, &apu, "Roms/", "");
+    
+    gb::hashing_video_sink video;
+    emulator.video = &video;
+    emulator.profile = profile;
+    
+    if (replay) {
+        replay->rewind();
+        emulator.input = replay;
+    }
+    
+    emulator.init("Files/bios.bin");
+    emulator.load_rom(rom_name);
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (int i = 0; i < frames; i++)
+        emulator.emulate_frame();
+    
+    PassResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.instructions = emulator.total_instructions;
+    result.cycles = emulator.total_cycles;
+    result.bus_reads = bus.read_count;
+    result.bus_writes = bus.write_count;
+    result.last_hash = video.last_hash;
+    return result;
+}
+
+// Function to run a rom and print its results as a JSON object - the speed comes from a run without profiling, and the
+// shares from a second, profiled run
+void run_rom(std::string rom_name, int frames, gb::input_replay* replay, bool profiled, bool audio){
+    PassResult result = run_pass(rom_name, frames, replay, nullptr, audio);
+    
+    std::cout << "    {\"rom\": " << json_string(rom_name) << ", \"frames\": " << frames
+              << ", \"seconds\": " << result.seconds
+              << ", \"fps\": " << frames / result.seconds
+              << ", \"mips\": " << result.instructions / result.seconds / 1e6
+              << ", \"ns_per_frame\": " << 1e9 * result.seconds / frames
+              << ", \"instructions\": " << result.instructions
+              << ", \"cycles\": " << result.cycles
+              << ", \"bus_reads\": " << result.bus_reads
+              << ", \"bus_writes\": " << result.bus_writes;
+    
+    if (profiled) {
+        gb::subsystem_profile profile;
+        PassResult profiled_result = run_pass(rom_name, frames, replay, &profile, audio);
+        
+        std::cout << ", \"profiled_fps\": " << frames / profiled_result.seconds
+                  << ", \"share\": {\"cpu\": " << profile.share(gb::subsystem_profile::CPU)
+                  << ", \"ppu\": " << profile.share(gb::subsystem_profile::PPU)
+                  << ", \"bus\": " << profile.share(gb::subsystem_profile::BUS)
+                  << ", \"apu\": " << profile.share(gb::subsystem_profile::APU) << "}";
+    }
+    
+    std::cout << ", \"last_frame_hash\": \"" << std::hex << std::setw(16) << std::setfill('0') << result.last_hash
+              << std::dec << std::setfill(' ') << "\"}";
+}
+
+int main(int argc, const char** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 0;
+    std::vector<std::string> roms;
+    std::string input_path;
+    bool profiled = true;
+    bool audio = true;
+    
+    for (int i = 2; i < argc; i++){
+        if (strcmp(argv[i], "--input") == 0 and i + 1 < argc)
+            input_path = argv[++i];
+        else if (strcmp(argv[i], "--no-profile") == 0)
+            profiled = false;
+        else if (strcmp(argv[i], "--no-audio") == 0)
+            audio = false;
+        else
+            roms.push_back(argv[i]);
+    }
+    
+    if (frames <= 0 or roms.empty()) {
+        std::cerr << "Usage: emulation_benchmark <frames> <rom name> [rom name ...] [--input <file>] [--no-profile] [--no-audio]"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    gb::input_replay replay;
+    if (!input_path.empty() and !replay.load(input_path)) {
+        std::cerr << "Could not read input file " << input_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    std::cout << std::setprecision(6) << "{\n  \"frames\": " << frames << ", \"profiled\": " << (profiled ? "true" : "false")
+              << ", \"audio\": " << (audio ? "true" : "false")
+              << ", \"input\": " << json_string(input_path) << ",\n  \"results\": [\n";
+    
+    for (size_t i = 0; i < roms.size(); i++){
+        run_rom(roms[i], frames, input_path.empty() ? nullptr : &replay, profiled, audio);
+        std::cout << (i + 1 < roms.size() ? ",\n" : "\n");
+    }
+    
+    std::cout << "  ]\n}" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+// Created by Niklas on 19/10/2026.
+// Microbenchmarks for the hot kernels of each subsystem, so optimising one of them can be measured on its own
+// Every kernel runs on fixed inputs from a seeded random generator, and reports ns per operation and throughput
+// Run from the repository folder: micro_benchmark [seconds per kernel] [seed] [kernel name ...], eg micro_benchmark 0.5
+// Built as the micro_benchmark target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -pthread -I. -IAudio -IBusDevices -IMappers Benchmarks/micro_benchmark.cpp instructions.cpp
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstring>
+
+#include "bus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "apu.h"
+
+// Small random generator (xorshift32) so every run uses the same inputs for a given seed
+struct Random {
+    uint32_t state;
+    
+    uint32_t next(){
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+// Stores a kernel to measure - run does one batch of work and returns the number of operations it did
+struct Kernel {
+    std::string name;
+    std::string unit;
+    std::function<long()> run;
+};
+
+// Stores a result which depends on every kernel's output, so the compiler cannot remove the work
+volatile uint64_t sink = 0;
+
+// Function to run a kernel in batches for at least min_seconds, and print its ns per operation and throughput
+void measure(Kernel& kernel, double min_seconds){
+    typedef std::chrono::steady_clock clock;
+    
+    // Runs one batch first, so the inputs are in the cache
+    kernel.run();
+    
+    long operations = 0;
+    double seconds = 0;
+    clock::time_point start = clock::now();
+    
+    while (seconds < min_seconds) {
+        operations += kernel.run();
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    
+    std::cout << std::left << std::setw(28) << kernel.name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(12) << 1e9 * seconds / operations
+              << std::setprecision(2) << std::setw(14) << operations / seconds / 1e6 << " M" << kernel.unit << "/s" << std::endl;
+}
+
+int main(int argc, const char** argv) {
+    double min_seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+    uint32_t seed = argc > 2 ? (uint32_t)std::strtoul(argv[2], nullptr, 0) : 0x2545F491;
+    Random random = {seed ? seed : 1};
+    
+    // Sets up the hardware with a rom, without running it - the kernels only use the memory map and registers
+    gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
+    cpu.connect_bus(&bus);
+    ppu.connect_bus(&bus);
+    apu.connect_bus(&bus);
+    cpu.init();
+    ppu.init();
+    apu.init();
+    bus.load_bios("Files/bios.bin");
+    bus.load_rom_file("Roms/tetris.gb", "Saves/tetris_save.bin");
+    bus.write(0xFF50, 0x01);
+    
+    // Random addresses across the whole memory map for reads, and in VRAM, WRAM, OAM and HRAM for writes
+    // (writes elsewhere switch rom banks or start DMA, which would change what is measured, and writes to WRAM
+    // stay above D000 so they do not overwrite the cpu's program)
+    const int num_addresses = 4096;
+    std::vector<uint16_t> read_addresses(num_addresses), write_addresses(num_addresses);
+    std::vector<uint8_t> write_data(num_addresses);
+    const uint16_t write_regions[4][2] = {{0x8000, 0x2000}, {0xD000, 0x1000}, {0xFE00, 0xA0}, {0xFF80, 0x7F}};
+    
+    for (int i = 0; i < num_addresses; i++){
+        read_addresses[i] = random.next();
+        const uint16_t* region = write_regions[random.next() % 4];
+        write_addresses[i] = region[0] + random.next() % region[1];
+        write_data[i] = random.next();
+    }
+    
+    // Random program for the cpu in WRAM: register loads and arithmetic (no memory writes, jumps or halts),
+    // ending in a jump back to the start
+    const uint16_t program_start = 0xC000;
+    const int program_length = 2048;
+    for (int i = 0; i < program_length; i++){
+        uint8_t opcode;
+        do {
+            opcode = 0x40 + random.next() % 0x80;
+        } while (opcode >= 0x70 and opcode <= 0x77);
+        
+        bus.write(program_start + i, opcode);
+    }
+    bus.write(program_start + program_length, 0xC3);
+    bus.write(program_start + program_length + 1, program_start & 0xFF);
+    bus.write(program_start + program_length + 2, program_start >> 8);
+    
+    // Random tile data, maps and sprites in VRAM and OAM
+    for (uint16_t addr = 0x8000; addr < 0xA000; addr++)
+        bus.write(addr, random.next());
+    for (uint16_t addr = 0xFE00; addr < 0xFEA0; addr++)
+        bus.write(addr, random.next());
+    
+    // LCD registers with the background, window and sprites all enabled, so draw_scanline takes every path
+    gb::lcd_registers regs = {};
+    regs.lcd_enabled = true;
+    regs.window_map = 0x9C00;
+    regs.window_enabled = true;
+    regs.unsigned_tile_data = false;
+    regs.background_map = 0x9800;
+    regs.sprite_height = 16;
+    regs.sprites_enabled = true;
+    regs.background_enabled = true;
+    regs.scy = random.next(); regs.scx = random.next();
+    regs.bgp = 0xE4; regs.obp0 = 0xD2; regs.obp1 = 0x1B;
+    regs.wy = 72; regs.wx = 87;
+    
+    const uint32_t host_pallette[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+    std::unique_ptr<gb::frame> frame(new gb::frame());
+    
+    // Turns on all sound channels with random settings for the apu kernels
+    bus.write(0xFF26, 0x80);
+    bus.write(0xFF24, 0x77);
+    bus.write(0xFF25, 0xFF);
+    const uint16_t trigger_registers[4] = {0xFF14, 0xFF19, 0xFF1E, 0xFF23};
+    for (uint16_t addr = 0xFF10; addr < 0xFF24; addr++)
+        bus.write(addr, random.next());
+    for (uint16_t addr: trigger_registers)
+        bus.write(addr, 0x80 | random.next());
+    
+    // Channels at full volume with random frequencies, run for one output sample period (95 clocks) per operation,
+    // with a callback which sums their outputs at each step
+    gb::SquareChannel square_channel;
+    gb::WaveChannel wave_channel;
+    gb::NoiseChannel noise_channel;
+    square_channel.set_frequency(random.next() % 2048);
+    wave_channel.set_frequency(random.next() % 2048);
+    uint8_t wave_pattern[16];
+    for (uint8_t& byte: wave_pattern)
+        byte = random.next();
+    wave_channel.trigger(wave_pattern);
+    noise_channel.set_frequency(random.next());
+    square_channel.enabled = wave_channel.enabled = noise_channel.enabled = true;
+    square_channel.volume = noise_channel.volume = 15;
+    const int sample_clocks = 95;
+    const int samples_per_batch = 4096;
+    
+    // VGM logger for the apu kernels, which discards what it writes
+    gb::vgm_logger vgm_logger("/dev/null");
+    vgm_logger.start(0);
+    
+    const uint8_t* vram = bus.get_vram();
+    const uint8_t* oam = bus.get_oam();
+    
+    std::vector<Kernel> kernels = {
+        {"bus::read", "reads", [&]() {
+            uint64_t total = 0;
+            for (uint16_t addr: read_addresses)
+                total += bus.read(addr);
+            sink = sink + total;
+            return (long)num_addresses;
+        }},
+        {"bus::write", "writes", [&]() {
+            for (int i = 0; i < num_addresses; i++)
+                bus.write(write_addresses[i], write_data[i]);
+            return (long)num_addresses;
+        }},
+        {"cpu::execute", "instructions", [&]() {
+            cpu.PC = program_start;
+            cpu.IME = false;
+            bus.write(0xFFFF, 0x00);
+            const int instructions = 4096;
+            for (int i = 0; i < instructions; i++)
+                cpu.run_instruction();
+            sink = sink + cpu.A;
+            return (long)instructions;
+        }},
+        {"ppu::draw_scanline", "pixels", [&]() {
+            for (int y = 0; y < 144; y++)
+                gb::ppu::draw_scanline(y, regs, vram, oam, host_pallette, true, *frame);
+            sink = sink + frame->row_hashes[143];
+            return 144L * 160;
+        }},
+        {"ppu::get_tile_data", "tiles", [&]() {
+            for (int tile = 0; tile < 384; tile++)
+                ppu.get_tile_data(tile);
+            sink = sink + ppu.current_tile[63];
+            return 384L;
+        }},
+        {"apu::run", "cycles", [&]() {
+            // Runs the apu after each of a series of 2 cycle (8 clock) instructions
+            const int cycles = 16384;
+            for (int i = 0; i < cycles; i += 2)
+                apu.run(8);
+            return (long)cycles;
+        }},
+        {"apu::run + writes", "cycles", [&]() {
+            // A sound register is written every 64 cycles, so the apu also updates its channel settings
+            const int cycles = 16384;
+            for (int i = 0; i < cycles; i += 2){
+                if (i % 64 == 0)
+                    bus.write(0xFF10 + random.next() % 0x14, random.next());
+                apu.run(8);
+            }
+            return (long)cycles;
+        }},
+        {"apu::run, no synthesis", "cycles", [&]() {
+            // As apu::run + writes, but only keeping the state games can read, to compare with full synthesis
+            const int cycles = 16384;
+            apu.synthesis = false;
+            for (int i = 0; i < cycles; i += 2){
+                if (i % 64 == 0)
+                    bus.write(0xFF10 + random.next() % 0x14, random.next());
+                apu.run(8);
+            }
+            apu.synthesis = true;
+            return (long)cycles;
+        }},
+        {"apu::run + writes, VGM log", "cycles", [&]() {
+            // As apu::run + writes, with every write also recorded by a VGM logger (into /dev/null)
+            const int cycles = 16384;
+            apu.connect_vgm_logger(&vgm_logger);
+            for (int i = 0; i < cycles; i += 2){
+                if (i % 64 == 0)
+                    bus.write(0xFF10 + random.next() % 0x14, random.next());
+                apu.run(8);
+            }
+            apu.connect_vgm_logger(nullptr);
+            return (long)cycles;
+        }},
+        {"SquareChannel::run", "samples", [&]() {
+            int total = 0;
+            for (int i = 0; i < samples_per_batch; i++){
+                square_channel.run(sample_clocks, [&](int, int output){ total += output; });
+            }
+            sink = sink + total;
+            return (long)samples_per_batch;
+        }},
+        {"WaveChannel::run", "samples", [&]() {
+            int total = 0;
+            for (int i = 0; i < samples_per_batch; i++){
+                wave_channel.run(sample_clocks, [&](int, int output){ total += output; });
+            }
+            sink = sink + total;
+            return (long)samples_per_batch;
+        }},
+        {"NoiseChannel::run", "samples", [&]() {
+            int total = 0;
+            for (int i = 0; i < samples_per_batch; i++){
+                noise_channel.run(sample_clocks, [&](int, int output){ total += output; });
+            }
+            sink = sink + total;
+            return (long)samples_per_batch;
+        }}
+    };
+    
+    // Band-limited synthesis at each quality level, making 44100 Hz samples from frames of 8192 clocks with 64 changes
+    // in amplitude each (about 33000 changes per second, as busy music makes), at random clocks
+    const int blip_frame_clocks = 8192;
+    const int changes_per_frame = 64;
+    std::vector<int> change_clocks(changes_per_frame), change_deltas(changes_per_frame);
+    for (int i = 0; i < changes_per_frame; i += 2){
+        change_clocks[i] = random.next() % blip_frame_clocks;
+        change_clocks[i + 1] = random.next() % blip_frame_clocks;
+        change_deltas[i] = random.next() % 240 - 120;
+        change_deltas[i + 1] = -change_deltas[i];
+    }
+    
+    const gb::blip_buffer::quality qualities[3] = {gb::blip_buffer::LOW, gb::blip_buffer::MEDIUM, gb::blip_buffer::HIGH};
+    const std::string quality_names[3] = {"low", "medium", "high"};
+    std::vector<gb::blip_buffer> blip_buffers(3);
+    std::vector<int16_t> blip_samples(256);
+    
+    for (int q = 0; q < 3; q++){
+        gb::blip_buffer* buffer = &blip_buffers[q];
+        buffer->set_rates(4194304, 44100, blip_frame_clocks * 44100 / 4194304 + 2, qualities[q]);
+        
+        kernels.push_back({"blip_buffer (" + quality_names[q] + ")", "samples", [&, buffer]() {
+            long samples = 0;
+            for (int frame = 0; frame < 64; frame++){
+                for (int i = 0; i < changes_per_frame; i++)
+                    buffer->add_delta(change_clocks[i], change_deltas[i]);
+                buffer->end_frame(blip_frame_clocks);
+                samples += buffer->read_samples(&blip_samples[0], buffer->samples_available(), 1);
+            }
+            sink = sink + blip_samples[0];
+            return samples;
+        }});
+    }
+    
+    // The blip_buffer kernels use the instruction set chosen for this cpu at run time
+    const char* simd_names[3] = {"scalar", "sse4.1", "avx2"};
+    
+    std::cout << std::left << std::setw(28) << "Kernel" << std::right << std::setw(12) << "ns/op" << std::setw(14) << "Throughput"
+              << "   (seed 0x" << std::hex << seed << std::dec << ", blip_buffer uses "
+              << simd_names[gb::blip_buffer::best_simd_level()] << ")" << std::endl;
+    
+    for (Kernel& kernel: kernels){
+        // Only runs the kernels named on the command line, if any are
+        bool selected = argc <= 3;
+        for (int i = 3; i < argc; i++)
+            selected = selected or kernel.name == argv[i];
+        
+        if (selected)
+            measure(kernel, min_seconds);
+    }
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+// Created by Niklas on 19/10/2026.
+// Benchmark which compares the scanline and pixel FIFO ppu backends on some roms, to show what accuracy costs
+// Run from the repository folder: ppu_benchmark <frames> <rom name> [rom name ...], eg ppu_benchmark 3600 tetris zelda
+// Built as the ppu_benchmark target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -I. -IAudio -IBusDevices -IMappers Benchmarks/ppu_benchmark.cpp instructions.cpp -pthread
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+#include "EmulationController.h"
+#include "FifoBackend.h"
+
+// Stores the result of running a rom with one backend - the time taken, and each frame's shades
+struct BenchmarkResult {
+    double seconds;
+    std::vector<uint64_t> frame_hashes;
+};
+
+// Function to run a rom for a number of frames with a given ppu type, as fast as possible
+template <typename ppu_type>
+BenchmarkResult run_rom(std::string rom_name, int frames){
+    gb::cpu cpu; ppu_type ppu; gb::bus bus; gb::apu apu;
+    EmulationController<ppu_type> emulator(&cpu, &bus, &ppu, &apu, "Roms/", "Saves/");
+    emulator.init("Files/bios.bin");
+    emulator.load_rom(rom_name);
+    
+    BenchmarkResult result;
+    auto start = std::chrono::steady_clock::now();
+    
+    for (int i = 0; i < frames; i++){
+        emulator.emulate_frame();
+        
+        // Hashes the frame from its row hashes, so frames from both backends can be compared
+        if (ppu.frames.update())
+            result.frame_hashes.push_back(gb::hash_frame(ppu.frames.front()));
+    }
+    
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    apu.stop_all();
+    return result;
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: ppu_benchmark <frames> <rom name> [rom name ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    int frames = std::atoi(argv[1]);
+    
+    std::cout << std::left << std::setw(16) << "Rom" << std::right << std::setw(16) << "Scanline ms" << std::setw(16) << "FIFO ms"
+              << std::setw(12) << "Cost" << std::setw(20) << "Frames different" << std::endl;
+    
+    for (int i = 2; i < argc; i++){
+        BenchmarkResult scanline = run_rom<gb::ppu>(argv[i], frames);
+        BenchmarkResult fifo = run_rom<gb::fifo_ppu>(argv[i], frames);
+        
+        // Counts the frames where the backends drew something different, eg from mid-scanline effects
+        size_t compared = std::min(scanline.frame_hashes.size(), fifo.frame_hashes.size());
+        int different = 0;
+        for (size_t f = 0; f < compared; f++)
+            different += scanline.frame_hashes[f] != fifo.frame_hashes[f];
+        
+        std::cout << std::left << std::setw(16) << argv[i] << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(16) << 1000 * scanline.seconds / frames << std::setw(16) << 1000 * fifo.seconds / frames
+                  << std::setprecision(1) << std::setw(11) << 100 * (fifo.seconds / scanline.seconds - 1) << "%"
+                  << std::setw(20) << (std::to_string(different) + " / " + std::to_string(compared)) << std::endl;
+    }
+    
+    return EXIT_SUCCESS;
+}
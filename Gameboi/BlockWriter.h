@@ -0,0 +1,134 @@
+// Created by Niklas on 19/10/2026.
+// Class which writes data to a file in large blocks on its own thread, so the emulation thread never waits for the disk
+// Data is collected into a block which is handed to the writer thread once it is full - written blocks are reused,
+// so after the first few blocks adding data never allocates
+// Used by the audio file sink (see AudioFileSink.h) and the VGM logger (see VgmLogger.h)
+
+#ifndef BlockWriter_h
+#define BlockWriter_h
+
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace gb {
+    template <typename T>
+    class block_writer {
+    public:
+        // Constructor takes the number of items in each block, and the most full blocks which can wait to be written
+        // before adding data waits for the disk
+        block_writer(size_t _block_size, size_t _max_blocks = 16){
+            block_size = _block_size;
+            max_blocks = _max_blocks;
+        }
+        
+        // Destructor finishes writing
+        ~block_writer(){
+            stop();
+        }
+        
+        // Function to start writing to an open file, after anything already written to it
+        void start(FILE* _file){
+            stop();
+            file = _file;
+            block.reserve(block_size);
+            
+            running = true;
+            writer = std::thread(&block_writer::write_blocks, this);
+        }
+        
+        // Function to add data to the current block, handing it to the writer thread once it is full
+        void push(const T* data, size_t count){
+            block.insert(block.end(), data, data + count);
+            
+            if (block.size() >= block_size)
+                hand_over_block();
+        }
+        
+        // Function to write the data not yet written and wait for the writer thread to finish - the file is left open
+        void stop(){
+            if (!running)
+                return;
+            
+            hand_over_block();
+            {
+                std::lock_guard<std::mutex> lock(blocks_mutex);
+                running = false;
+            }
+            blocks_changed.notify_all();
+            writer.join();
+            file = nullptr;
+        }
+        
+        // Function to check whether the writer thread is running
+        bool is_running(){
+            return running;
+        }
+    
+    private:
+        // Stores the file being written, the items in each block, and the most full blocks which can wait
+        FILE* file = nullptr;
+        size_t block_size;
+        size_t max_blocks;
+        
+        // Stores the block being filled by the emulation thread
+        std::vector<T> block;
+        
+        // Stores the full blocks waiting to be written, and the empty blocks which can be filled again
+        std::deque<std::vector<T>> full_blocks;
+        std::vector<std::vector<T>> empty_blocks;
+        std::mutex blocks_mutex;
+        std::condition_variable blocks_changed;
+        
+        // Stores the writer thread, and whether it should keep waiting for blocks
+        std::thread writer;
+        bool running = false;
+        
+        // Function to hand the current block to the writer thread and start filling an empty one
+        void hand_over_block(){
+            std::unique_lock<std::mutex> lock(blocks_mutex);
+            blocks_changed.wait(lock, [this]{ return full_blocks.size() < max_blocks; });
+            
+            full_blocks.push_back(std::move(block));
+            block.clear();
+            if (!empty_blocks.empty()) {
+                block = std::move(empty_blocks.back());
+                empty_blocks.pop_back();
+            } else {
+                block.reserve(block_size);
+            }
+            
+            lock.unlock();
+            blocks_changed.notify_all();
+        }
+        
+        // Function which runs on the writer thread, writing full blocks until the writer is stopped
+        void write_blocks(){
+            std::unique_lock<std::mutex> lock(blocks_mutex);
+            
+            while (running or !full_blocks.empty()) {
+                if (full_blocks.empty()) {
+                    blocks_changed.wait(lock);
+                    continue;
+                }
+                
+                std::vector<T> data = std::move(full_blocks.front());
+                full_blocks.pop_front();
+                
+                // Writes without holding the lock, so the emulation can keep handing over blocks
+                lock.unlock();
+                blocks_changed.notify_all();
+                std::fwrite(data.data(), sizeof(T), data.size(), file);
+                data.clear();
+                lock.lock();
+                
+                empty_blocks.push_back(std::move(data));
+            }
+        }
+    };
+}
+
+#endif /* BlockWriter_h */
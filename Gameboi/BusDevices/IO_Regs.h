@@ -12,7 +12,7 @@ namespace gb {
     class io_regs {
     private:
         // Creates an array to store register states
-        uint8_t reg_data[0x4C];
+        uint8_t reg_data[0x4C] = {};
         
         // Stores the states of all buttons
         bool a, b, up, down, left, right, start, select = false;
@@ -73,6 +73,21 @@ namespace gb {
                     reg_data[0x04] = 0;
                     return;
                 }
+                
+                // LY (FF44) and the mode bits of STAT (FF41) are set by the PPU and cannot be written
+                if (addr == 0xFF44)
+                    return;
+                
+                if (addr == 0xFF41){
+                    reg_data[0x41] = (data & 0b11111100) | (reg_data[0x41] & 0b11);
+                    return;
+                }
+                
+                // Only bit 7 of NR52 (FF26) can be written - the channel status bits are set by the APU
+                if (addr == 0xFF26){
+                    reg_data[0x26] = (data & 0b10000000) | (reg_data[0x26] & 0b01111111);
+                    return;
+                }
                     
                 reg_data[addr - 0xFF00] = data;
             }
@@ -96,6 +111,11 @@ namespace gb {
         uint8_t get(uint8_t reg_num){
             return reg_data[reg_num];
         }
+        
+        // Function to set an item by its register ID, for devices such as the PPU updating their own registers
+        void set(uint8_t reg_num, uint8_t data){
+            reg_data[reg_num] = data;
+        }
     };
 }
 
@@ -11,7 +11,7 @@ namespace gb {
     class oam {
     private:
         // Array of 160 bytes to store data
-        uint8_t sprite_data[0xA0];
+        uint8_t sprite_data[0xA0] = {};
         
     public:
         // Constructor
@@ -26,6 +26,11 @@ namespace gb {
         void write(uint16_t addr, uint8_t data){
             sprite_data[addr - 0xFE00] = data;
         }
+        
+        // Function to get all of OAM as one array, indexed by address - FE00, for the ppu to draw from
+        const uint8_t* get_data(){
+            return sprite_data;
+        }
     };
 }
 
@@ -0,0 +1,51 @@
+// Created by Niklas on 19/10/2026.
+// Class to emulate the serial port, which sends a byte from SB (FF01) when a transfer is started by writing to SC (FF02)
+// No link cable is emulated, so every byte sent is captured as text (test roms print their results this way)
+// and 0xFF is received back
+
+#ifndef Serial_h
+#define Serial_h
+
+#include <stdint.h>
+#include <string>
+#include <iostream>
+
+namespace gb {
+    class serial_port {
+    private:
+        // Number of cycles left in the current transfer, or 0 if there is none
+        int transfer_cycles = 0;
+    
+    public:
+        // Stores every byte sent, in order
+        std::string output;
+        
+        // If true, every byte sent is also printed to stdout
+        bool echo = false;
+        
+        // Function called when SC is written - a transfer starts if bit 7 (start) and bit 0 (internal clock) are set
+        // Transfers using the external clock wait for another gameboy, so never complete
+        void write_control(uint8_t control, uint8_t data){
+            if ((control & 0x81) != 0x81)
+                return;
+            
+            output += (char)data;
+            if (echo)
+                std::cout << (char)data << std::flush;
+            
+            // 8 bits are sent at 8192 Hz, taking 512 cycles each
+            transfer_cycles = 8 * 512;
+        }
+        
+        // Function to do one cycle (4 clocks) - returns true when a transfer completes, requesting the serial interrupt
+        bool do_cycle(){
+            if (transfer_cycles == 0)
+                return false;
+            
+            transfer_cycles -= 4;
+            return transfer_cycles == 0;
+        }
+    };
+}
+
+#endif /* Serial_h */
@@ -0,0 +1,81 @@
+// Created by Niklas on 19/10/2026.
+// Class which compares each frame with the last frame a consumer used, to find which rows have changed
+// Each consumer (the screen texture, a recorder, a stream) keeps its own, and only uploads or encodes those rows
+
+#ifndef DirtyRows_h
+#define DirtyRows_h
+
+#include <vector>
+
+#include "ppu.h"
+
+namespace gb {
+    // Stores a range of rows, from first up to but not including last
+    struct row_range {
+        int first;
+        int last;
+    };
+    
+    class dirty_rows {
+    public:
+        // Ranges separated by at most merge_gap unchanged rows are joined, so a consumer makes fewer, larger updates
+        int merge_gap = 0;
+        
+        // Function to compare a frame with the last frame given, returning the ranges of rows which have changed
+        // Rows are compared by frame.row_hashes, which hash the shades - call invalidate if the host pallette changes
+        const std::vector<gb::row_range>& update(const gb::frame& frame){
+            ranges.clear();
+            int changed_rows = 0;
+            
+            for (int y = 0; y < 144; y++){
+                bool changed = !valid or frame.row_hashes[y] != hashes[y];
+                hashes[y] = frame.row_hashes[y];
+                
+                if (!changed)
+                    continue;
+                
+                changed_rows++;
+                
+                // Extends the last range if this row is close enough to it, otherwise starts a new one
+                if (!ranges.empty() and y - ranges.back().last <= merge_gap)
+                    ranges.back().last = y + 1;
+                else
+                    ranges.push_back({y, y + 1});
+            }
+            
+            valid = true;
+            total_changed_rows += changed_rows;
+            count++;
+            return ranges;
+        }
+        
+        // Function to forget the last frame, so every row of the next frame counts as changed
+        void invalidate(){
+            valid = false;
+        }
+        
+        // Functions to get the number of frames compared and the average fraction of rows which changed per frame
+        long frames() {return count;}
+        double dirty_fraction() {return count ? total_changed_rows / (144.0 * count) : 0;}
+        
+        // Function to clear the statistics
+        void reset_stats(){
+            total_changed_rows = 0;
+            count = 0;
+        }
+    
+    private:
+        // Stores the row hashes of the last frame, and whether there has been one since invalidate
+        uint64_t hashes[144];
+        bool valid = false;
+        
+        // Stores the ranges returned by the last update
+        std::vector<gb::row_range> ranges;
+        
+        // Stores the total number of changed rows and the number of frames compared
+        long long total_changed_rows = 0;
+        long count = 0;
+    };
+}
+
+#endif /* DirtyRows_h */
@@ -9,22 +9,106 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "apu.h"
+#include "Sinks.h"
+#include "SubsystemProfile.h"
 
+#include "SPSCQueue.h"
+#include "FrameTiming.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Number of clocks the gameboy runs per second
+#define CLOCK_SPEED 4194304.0
+
+// Number of frames the gameboy draws per second (4194304 clocks per second, 70224 clocks per frame)
+#define FRAME_RATE (CLOCK_SPEED / 70224.0)
+
+// Struct to store an input sent from the frontend to the emulation thread
+struct InputEvent {
+    enum Type {
+        KEY_STATES,       // data holds the button states (bit 0 - 7 = a, b, up, down, left, right, start, select)
+        KEY_PRESSED,      // a button was pressed - wakes the cpu from the stopped state
+        TOGGLE_EXECUTING, // pauses or resumes emulation
+        STEP_INSTRUCTION, // emulates one instruction while paused
+        STEP_SCANLINE,    // emulates one scanline while paused
+        STEP_FRAME,       // emulates one frame while paused
+        FAST_FORWARD,     // data is 1 to run as fast as possible, or 0 to run at normal speed
+        REPORT_TIMING     // data is 1 to print frame timing every second, or 0 to stop
+    };
+    
+    Type type;
+    uint8_t data = 0;
+};
+
+// The ppu type can be changed to use another ppu backend, eg gb::fifo_ppu (see ppu.h)
+template <typename ppu_type = gb::ppu>
 class EmulationController {
 private:
     // Stores pointers to all the hardware components (cpu, bus, ppu etc)
     gb::cpu* cpu;
     gb::bus* bus;
-    gb::ppu* ppu;
+    ppu_type* ppu;
     gb::apu* apu;
     
     // Stores the path to thr roms and saves folder
     std::string romspath;
     std::string savespath;
+    
+    // Stores how many frames have been skipped since the last drawn frame
+    int frames_skipped = 0;
+    
+    // Stores the emulation thread and whether it should keep running
+    std::thread emulation_thread;
+    std::atomic<bool> thread_running{false};
+    
+    // Frame skip used while fast forwarding on the emulation thread
+    const int fast_forward_skip = 4;
 
 public:
-    // Constructor takes in pointers to the hardware components as well as roms and saves folders and stores them
-    EmulationController(gb::cpu* _cpu, gb::bus* _bus, gb::ppu* _ppu, gb::apu* _apu, std::string _romspath, std::string _savespath) {
+    // Stores the total number of clocks and instructions emulated
+    long long total_cycles = 0;
+    long long total_instructions = 0;
+    
+    // Queue of inputs sent by the frontend to the emulation thread
+    gb::spsc_queue<InputEvent, 256> inputs;
+    
+    // Mutex held by the emulation thread while it emulates - the frontend locks it to read a consistent
+    // state for debug views, so the cinematic view never waits on the emulation
+    std::mutex state_mutex;
+    
+    // Stores whether the LCD was enabled at the end of the last frame, for the frontend
+    std::atomic<bool> lcd_enabled{true};
+
+    // Frame skip settings - skipped frames are emulated exactly, but are not drawn into the frame buffer
+    // frame_skip is the number of frames skipped after every drawn frame
+    int frame_skip = 0;
+    
+    // If adaptive frame skip is enabled, frame_skip is adjusted by update_frame_skip (up to max_frame_skip)
+    bool adaptive_frame_skip = false;
+    int max_frame_skip = 8;
+    
+    // Stores whether the last emulated frame was drawn - the frontend does not need to draw the screen otherwise
+    bool frame_rendered = true;
+    
+    // Optional sinks for a frontend without its own threads, eg a headless runner (see Sinks.h)
+    // The video sink is given each drawn frame from the ppu's triple buffer, so it must be the only reader of it,
+    // and the input source is asked for the button states before each frame
+    gb::video_sink* video = nullptr;
+    gb::input_source* input = nullptr;
+    
+    // If set, and the apu's audio sink has a queue, emulation speed is kept by the audio clock rather than real time -
+    // after each frame the emulation waits until the sink's queue is no more than half full
+    bool audio_sync = false;
+    
+    // Optional profile which times a sample of instructions to measure each subsystem's share of the time
+    gb::subsystem_profile* profile = nullptr;
+
+    // Constructor takes in pointers to the hardware components as well as roms and saves folders and stores them - an
+    // empty saves folder means cartridge ram is neither loaded from nor saved to a file
+    EmulationController(gb::cpu* _cpu, gb::bus* _bus, ppu_type* _ppu, gb::apu* _apu, std::string _romspath, std::string _savespath) {
         cpu = _cpu;
         bus = _bus;
         ppu = _ppu;
@@ -34,6 +118,11 @@ public:
         savespath = _savespath;
     }
     
+    // Destructor stops the emulation thread if it is still running, as destroying a joinable thread terminates
+    ~EmulationController(){
+        stop_thread();
+    }
+    
     // Function to initialise the emulation
     void init(std::string bios_path) {
         cpu->connect_bus(bus);
@@ -49,18 +138,60 @@ public:
     
     // Function to load a rom
     void load_rom(std::string rom_name) {
-        bus->load_rom_file(romspath + rom_name + ".gb", savespath + rom_name + "_save.bin");
+        bus->load_rom_file(romspath + rom_name + ".gb", savespath.empty() ? "" : savespath + rom_name + "_save.bin");
     }
     
     // Function to emulate one instruction - returns the number of cpu cycles
     long emulate_instruction(){
+        if (profile and profile->sample())
+            return emulate_instruction_profiled();
+        
         cpu->run_instruction();
         for (int i = 0; i < (cpu->cycles / 4); i++) {
             ppu->do_cycle();
             bus->do_cycle();
-            apu->do_cycle();
         }
         
+        // The apu only needs to handle register writes and its frame sequencer, so it runs once per instruction
+        apu->run(cpu->cycles);
+
+        total_cycles += cpu->cycles;
+        total_instructions++;
+        return cpu->cycles;
+    }
+    
+    // Function to emulate one instruction exactly as emulate_instruction does, timing each subsystem
+    // The bus times the reads and writes made during the instruction, which are taken out of the cpu, ppu and apu time
+    long emulate_instruction_profiled(){
+        typedef gb::subsystem_profile::clock clock;
+        bus->profile = profile;
+        
+        clock::time_point start = clock::now();
+        cpu->run_instruction();
+        clock::time_point end = clock::now();
+        profile->add(gb::subsystem_profile::CPU, start, end);
+        
+        for (int i = 0; i < (cpu->cycles / 4); i++) {
+            start = clock::now();
+            ppu->do_cycle();
+            end = clock::now();
+            profile->add(gb::subsystem_profile::PPU, start, end);
+            
+            start = clock::now();
+            bus->do_cycle();
+            end = clock::now();
+            profile->add(gb::subsystem_profile::BUS, start, end);
+        }
+        
+        start = clock::now();
+        apu->run(cpu->cycles);
+        end = clock::now();
+        profile->add(gb::subsystem_profile::APU, start, end);
+        
+        bus->profile = nullptr;
+
+        total_cycles += cpu->cycles;
+        total_instructions++;
         return cpu->cycles;
     }
     
@@ -71,19 +202,194 @@ public:
         }
         
         ppu->scanline_over = false;
-        return false;
     }
     
     // Function to emulate one frame - returning true pauses emulation for breakpoints
-    bool emulate_frame(){
+    // If force_render is true, the frame is drawn regardless of the frame skip setting
+    bool emulate_frame(bool force_render = false){
+        if (input)
+            apply_key_states(input->get_key_states());
+        
+        // Only draws this frame if enough frames have been skipped since the last drawn one
+        ppu->render_frame = force_render or frames_skipped >= frame_skip;
+        
         while (!ppu->frame_over) {
             emulate_instruction();
         }
         
         ppu->frame_over = false;
+        
+        frame_rendered = ppu->render_frame;
+        frames_skipped = frame_rendered ? 0 : frames_skipped + 1;
+        
+        // Hands the drawn frame to the video sink
+        if (video and frame_rendered) {
+            ppu->finish_rendering();
+            if (ppu->frames.update())
+                video->present_frame(ppu->frames.front());
+        }
         return false;
     }
-
+    
+    // Function to store the button states (bit 0 - 7 = a, b, up, down, left, right, start, select) on the bus
+    void apply_key_states(uint8_t states){
+        bus->store_key_states(states & 0x01, states & 0x02, states & 0x04, states & 0x08,
+                              states & 0x10, states & 0x20, states & 0x40, states & 0x80);
+    }
+    
+    // Function to adjust the adaptive frame skip, given how many seconds the host took to emulate and draw
+    // the frames since the last drawn frame - more frames are skipped if the host cannot keep up with the gameboy
+    void update_frame_skip(double host_seconds){
+        if (!adaptive_frame_skip)
+            return;
+        
+        // Time the gameboy would have taken to display these frames
+        double budget = (frame_skip + 1) / FRAME_RATE;
+        
+        if (host_seconds > budget and frame_skip < max_frame_skip)
+            frame_skip++;
+        // Only draws more frames again if the host would still keep up with one less skipped frame
+        else if (host_seconds < 0.8 * frame_skip / FRAME_RATE and frame_skip > 0)
+            frame_skip--;
+    }
+    
+    // Function to start emulating on a separate thread - inputs are then sent through the inputs queue,
+    // and frames are received through the ppu's triple buffer
+    void start_thread(){
+        thread_running = true;
+        emulation_thread = std::thread(&EmulationController::run_thread, this);
+    }
+    
+    // Function to stop the emulation thread and wait for it to finish
+    void stop_thread(){
+        thread_running = false;
+        if (emulation_thread.joinable())
+            emulation_thread.join();
+        
+        ppu->finish_rendering();
+    }
+    
+private:
+    // Function which runs on the emulation thread
+    // Emulation speed is kept by comparing the emulated clocks to real time (or by the audio clock, see audio_sync),
+    // not by the display's vsync
+    void run_thread(){
+        typedef std::chrono::steady_clock clock;
+        
+        bool executing = true;
+        bool fast_forward = false;
+        bool report_timing = false;
+        
+        // Real time and emulated clocks at the point emulation speed is measured from
+        clock::time_point sync_time = clock::now();
+        long long sync_cycles = total_cycles;
+        
+        // Measures the time between emulated frames, and the time spent emulating since the last drawn frame
+        gb::frame_timing timing;
+        double busy_seconds = 0;
+        
+        // Stores the bus write count when timing was last reported, to report the bus writes per frame
+        unsigned long long reported_writes = bus->write_count;
+        
+        // Stores the frame skip setting to go back to after fast forwarding
+        bool adaptive_setting = adaptive_frame_skip;
+        
+        while (thread_running) {
+            // Applies all inputs sent by the frontend
+            bool step_instruction = false, step_scanline = false, step_frame = false;
+            InputEvent event;
+            while (inputs.pop(event)) {
+                switch (event.type) {
+                    case InputEvent::KEY_STATES: apply_key_states(event.data); break;
+                    case InputEvent::KEY_PRESSED: cpu->stopped = false; break;
+                    case InputEvent::TOGGLE_EXECUTING: executing = !executing; break;
+                    case InputEvent::STEP_INSTRUCTION: step_instruction = true; break;
+                    case InputEvent::STEP_SCANLINE: step_scanline = true; break;
+                    case InputEvent::STEP_FRAME: step_frame = true; break;
+                    case InputEvent::REPORT_TIMING:
+                        report_timing = event.data;
+                        timing.reset();
+                        reported_writes = bus->write_count;
+                        break;
+                    case InputEvent::FAST_FORWARD:
+                        // Fast forward uses a fixed frame skip, otherwise frame skip adapts to the host's speed
+                        // Sound is not synthesised while fast forwarding, since it could not be played in time anyway
+                        fast_forward = event.data;
+                        adaptive_frame_skip = fast_forward ? false : adaptive_setting;
+                        frame_skip = fast_forward ? fast_forward_skip : 0;
+                        apu->synthesis = !fast_forward;
+                        break;
+                }
+            }
+            
+            // While paused, waits for inputs, emulating single steps when asked
+            if (!executing) {
+                if (step_frame or step_scanline or step_instruction) {
+                    std::lock_guard<std::mutex> lock(state_mutex);
+                    if (step_frame) emulate_frame(true);
+                    else if (step_scanline) emulate_scanline();
+                    else emulate_instruction();
+                    
+                    // Shows the stepped frame straight away if it is being drawn in parallel
+                    ppu->finish_rendering();
+                    lcd_enabled = gb::Utils::get_bit(bus->get_ioreg(gb::regNames::LCDC), 7);
+                }
+                
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                sync_time = clock::now();
+                sync_cycles = total_cycles;
+                timing.restart();
+                continue;
+            }
+            
+            // Emulates one frame
+            clock::time_point frame_start = clock::now();
+            {
+                std::lock_guard<std::mutex> lock(state_mutex);
+                if (emulate_frame())
+                    executing = false;
+                lcd_enabled = gb::Utils::get_bit(bus->get_ioreg(gb::regNames::LCDC), 7);
+            }
+            busy_seconds += std::chrono::duration<double>(clock::now() - frame_start).count();
+            
+            if (frame_rendered) {
+                update_frame_skip(busy_seconds);
+                busy_seconds = 0;
+            }
+            
+            // Waits until the audio sink has played enough of its queue, unless fast forwarding
+            gb::audio_sink* audio = apu->get_audio();
+            if (audio_sync and audio and audio->fill_level() >= 0 and !fast_forward) {
+                while (thread_running and audio->fill_level() > 0.5)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                
+                sync_time = clock::now();
+                sync_cycles = total_cycles;
+            }
+            // Otherwise waits until real time catches up with the emulated clocks, unless fast forwarding
+            else {
+                clock::time_point target = sync_time + std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>((total_cycles - sync_cycles) / CLOCK_SPEED));
+                
+                if (fast_forward or clock::now() > target + std::chrono::milliseconds(100)) {
+                    // If fast forwarding or too far behind, measures emulation speed from now instead
+                    sync_time = clock::now();
+                    sync_cycles = total_cycles;
+                } else {
+                    std::this_thread::sleep_until(target);
+                }
+            }
+            
+            // Reports frame timing every second
+            timing.tick();
+            if (report_timing and timing.frames() >= 60) {
+                std::cout << "Emulation frame time: " << timing.summary() << ", frame skip " << frame_skip
+                          << ", bus writes per frame " << (bus->write_count - reported_writes) / timing.frames() << std::endl;
+                timing.reset();
+                reported_writes = bus->write_count;
+            }
+        }
+    }
 };
 
 
@@ -0,0 +1,312 @@
+// Created by Niklas on 19/10/2026.
+// PPU backend which draws one pixel per clock through a background FIFO and a sprite FIFO, like the real ppu
+// Mode 3 gets longer with fine scrolling (SCX % 8), the window and sprites, and register writes during mode 3 take
+// effect part way through the scanline - this costs more per cycle than the scanline backend
+
+#ifndef FifoBackend_h
+#define FifoBackend_h
+
+#include <algorithm>
+
+#include "ppu.h"
+
+namespace gb {
+    class fifo_backend {
+    public:
+        // Pixels are drawn by the backend during mode 3, not by the ppu at the start of h-blank
+        static const bool draws_whole_lines = false;
+        
+        // Function called every cycle from the end of mode 2 until it returns false - draws the next 4 pixel clocks
+        // and returns whether mode 3 is still going, which is until all 160 pixels have been drawn
+        template <typename ppu_type>
+        bool do_mode3(ppu_type& ppu){
+            // V-blank lines keep the same timing as the scanline backend
+            if (ppu.num_scanlines > 143)
+                return ppu.num_cycles < 252;
+            
+            // Starts the scanline on the first cycle after mode 2
+            if (ppu.mode == 2)
+                start_line(ppu);
+            
+            // Mode 3 can never run into the next scanline
+            if (line_done or ppu.num_cycles >= 456)
+                return false;
+            
+            for (int dot = 0; dot < 4 and !line_done; dot++){
+                do_dot(ppu);
+            }
+            
+            return true;
+        }
+    
+    private:
+        // Stores a pixel in the sprite FIFO (colour 0 is transparent, or no sprite)
+        struct sprite_pixel {
+            uint8_t colour;
+            bool pallette;
+            bool priority;
+        };
+        
+        // Stores the background FIFO - pixels are read from position bg_position, and there are bg_count left
+        uint8_t bg_fifo[8];
+        int bg_position = 0;
+        int bg_count = 0;
+        
+        // Stores the sprite FIFO - sprite_fifo[0] is mixed with the next background pixel
+        sprite_pixel sprite_fifo[8];
+        
+        // Stores the background fetcher's state - the step (0 = tile index, 1 = low byte, 2 = high byte, 3 = push),
+        // how many clocks it has spent on the step, the tile column it is fetching and the data it has fetched
+        int fetch_step = 0;
+        int fetch_clocks = 0;
+        int fetch_x = 0;
+        uint8_t tile_index = 0;
+        uint8_t tile_low = 0;
+        uint8_t tile_high = 0;
+        
+        // Stores the x position of the next pixel, how many pixels to throw away before drawing (fine scroll, or the
+        // window starting left of the screen), and how many clocks the fetcher and drawing are paused for
+        int x = 0;
+        int discard = 0;
+        int stall = 0;
+        bool line_done = true;
+        
+        // Stores whether the window has been reached on this scanline and whether LY has matched WY this frame, and
+        // the window's own line counter, which only counts scanlines on which the window was drawn
+        bool fetching_window = false;
+        bool window_drawn = false;
+        bool window_y_reached = false;
+        int window_line = 0;
+        
+        // Stores the OAM indices of the sprites on this scanline in the order they are fetched, and the next one to fetch
+        uint8_t sprites[10];
+        int num_sprites = 0;
+        int next_sprite = 0;
+        
+        // Stores the background tile the last sprite penalty was for, as later sprites on the same tile cost less
+        int penalty_tile = -1;
+        
+        // Function to reset the FIFOs and fetcher, and find the sprites on this scanline, at the start of mode 3
+        template <typename ppu_type>
+        void start_line(ppu_type& ppu){
+            const gb::lcd_registers& lcd = ppu.lcd;
+            int y = ppu.num_scanlines;
+            
+            // The window line counter restarts each frame, and moves on after each scanline the window was drawn on
+            if (y == 0) {
+                window_y_reached = false;
+                window_line = 0;
+            } else if (window_drawn)
+                window_line++;
+            
+            if (y == lcd.wy)
+                window_y_reached = true;
+            
+            bg_position = 0;
+            bg_count = 0;
+            std::fill(std::begin(sprite_fifo), std::end(sprite_fifo), sprite_pixel{0, 0, 0});
+            
+            fetch_step = 0;
+            fetch_clocks = 0;
+            fetch_x = 0;
+            
+            // The first tile fetch of each scanline is thrown away, taking 6 clocks, and the first SCX % 8 pixels are scrolled off
+            x = 0;
+            discard = lcd.scx % 8;
+            stall = 6;
+            line_done = false;
+            
+            fetching_window = false;
+            window_drawn = false;
+            penalty_tile = -1;
+            
+            // OAM scan - the first 10 sprites in OAM which are on this scanline, fetched from left to right
+            // Sprites with the same x are fetched in OAM order, which gives them priority
+            const uint8_t* oam = ppu.bus->get_oam();
+            num_sprites = 0;
+            next_sprite = 0;
+            for (int sprite_num = 0; sprite_num < 40 and num_sprites < 10; sprite_num++){
+                int dy = oam[4 * sprite_num] - y;
+                if (dy > 16 - lcd.sprite_height and dy <= 16)
+                    sprites[num_sprites++] = sprite_num;
+            }
+            
+            std::stable_sort(sprites, sprites + num_sprites, [oam](uint8_t a, uint8_t b){
+                return oam[4 * a + 1] < oam[4 * b + 1];
+            });
+        }
+        
+        // Function to do one pixel clock of mode 3
+        template <typename ppu_type>
+        void do_dot(ppu_type& ppu){
+            const gb::lcd_registers& lcd = ppu.lcd;
+            
+            if (stall > 0) {
+                stall--;
+                return;
+            }
+            
+            // When the window is reached, the background FIFO is cleared and the fetcher restarts on the window's tiles
+            if (!fetching_window and lcd.window_enabled and window_y_reached and x + 7 >= lcd.wx) {
+                fetching_window = true;
+                window_drawn = true;
+                bg_count = 0;
+                fetch_step = 0;
+                fetch_clocks = 0;
+                fetch_x = 0;
+                
+                // If the window starts left of the screen (WX < 7), its first pixels are thrown away
+                discard = std::max(0, 7 - lcd.wx);
+            }
+            
+            // When a sprite is reached, it is fetched into the sprite FIFO, pausing drawing
+            if (discard == 0 and lcd.sprites_enabled and next_sprite < num_sprites and ppu.bus->get_oam()[4 * sprites[next_sprite] + 1] <= x + 8) {
+                fetch_sprite(ppu, sprites[next_sprite++]);
+                return;
+            }
+            
+            do_fetcher(ppu);
+            
+            // Shifts out one pixel if there are any, mixing it with the sprite FIFO
+            if (bg_count == 0)
+                return;
+            
+            uint8_t bg_pixel = bg_fifo[bg_position++];
+            bg_count--;
+            
+            sprite_pixel sprite = sprite_fifo[0];
+            std::copy(sprite_fifo + 1, sprite_fifo + 8, sprite_fifo);
+            sprite_fifo[7] = {0, 0, 0};
+            
+            if (discard > 0) {
+                discard--;
+                return;
+            }
+            
+            if (ppu.render_frame)
+                draw_pixel(ppu, bg_pixel, sprite);
+            
+            if (++x == 160)
+                line_done = true;
+        }
+        
+        // Function to do one clock of the background fetcher - each step takes 2 clocks, and the row of 8 pixels is
+        // pushed on the first clock the background FIFO is empty
+        template <typename ppu_type>
+        void do_fetcher(ppu_type& ppu){
+            const gb::lcd_registers& lcd = ppu.lcd;
+            const uint8_t* vram = ppu.bus->get_vram();
+            int y = ppu.num_scanlines;
+            
+            if (fetch_step == 3) {
+                if (bg_count > 0)
+                    return;
+                
+                for (int i = 0; i < 8; i++){
+                    bg_fifo[i] = gb::Utils::get_bit(tile_low, 7 - i) + 2 * gb::Utils::get_bit(tile_high, 7 - i);
+                }
+                bg_position = 0;
+                bg_count = 8;
+                
+                fetch_x++;
+                fetch_step = 0;
+                return;
+            }
+            
+            if (++fetch_clocks < 2)
+                return;
+            fetch_clocks = 0;
+            
+            // Row of the tile map and row within the tile, from the window's line counter or the scrolled scanline
+            int map_y = fetching_window ? window_line : (y + lcd.scy) % 256;
+            
+            if (fetch_step == 0) {
+                // Gets the tile index from the window's tile map, or the background's tile map scrolled by SCX
+                if (fetching_window)
+                    tile_index = vram[lcd.window_map - 0x8000 + 32 * (map_y / 8) + (fetch_x % 32)];
+                else
+                    tile_index = vram[lcd.background_map - 0x8000 + 32 * (map_y / 8) + ((lcd.scx / 8 + fetch_x) % 32)];
+            } else {
+                // Gets the low then high byte of the tile's row
+                uint8_t data = vram[ppu_type::get_background_tile_offset(tile_index, lcd) + 2 * (map_y % 8) + fetch_step - 1];
+                if (fetch_step == 1)
+                    tile_low = data;
+                else
+                    tile_high = data;
+            }
+            
+            fetch_step++;
+        }
+        
+        // Function to fetch a sprite's row into the sprite FIFO - sprite pixels already in the FIFO take priority
+        template <typename ppu_type>
+        void fetch_sprite(ppu_type& ppu, uint8_t sprite_index){
+            const gb::lcd_registers& lcd = ppu.lcd;
+            const uint8_t* sprite = &ppu.bus->get_oam()[4 * sprite_index];
+            const uint8_t* vram = ppu.bus->get_vram();
+            
+            // Drawing pauses for 6 clocks, plus up to 5 more while the fetcher finishes the background tile the sprite
+            // is on - only the first sprite on each background tile waits for the fetcher
+            int sprite_x = sprite[1] - 8;
+            int tile = (std::max(sprite_x, 0) + lcd.scx) / 8;
+            if (tile != penalty_tile) {
+                stall = 11 - std::min(5, (std::max(sprite_x, 0) + lcd.scx) % 8) - 1;
+                penalty_tile = tile;
+            } else
+                stall = 6 - 1;
+            
+            // Calculates the row of the sprite to use, flipping y if flags bit 6 is set
+            uint8_t flags_byte = sprite[3];
+            int fine_y = ppu.num_scanlines - (sprite[0] - 16);
+            if (gb::Utils::get_bit(flags_byte, 6))
+                fine_y = (lcd.sprite_height - 1) - fine_y;
+            
+            // 8x16 sprites use the tile pair starting at an even index
+            int tile_index = sprite[2];
+            if (lcd.sprite_height == 16)
+                tile_index = (fine_y > 7) ? (tile_index & 0xFE) + 1 : tile_index & 0xFE;
+            
+            uint8_t pixel_low = vram[16 * tile_index + 2 * (fine_y % 8)];
+            uint8_t pixel_high = vram[16 * tile_index + 2 * (fine_y % 8) + 1];
+            
+            // Pixels of sprites partly off the left of the screen are skipped
+            int skipped = std::max(0, x - sprite_x);
+            for (int i = skipped; i < 8; i++){
+                // Flips x if flags bit 5 is set
+                int fine_x = gb::Utils::get_bit(flags_byte, 5) ? 7 - i : i;
+                uint8_t colour = gb::Utils::get_bit(pixel_low, 7 - fine_x) + 2 * gb::Utils::get_bit(pixel_high, 7 - fine_x);
+                
+                sprite_pixel& slot = sprite_fifo[i - skipped];
+                if (slot.colour == 0 and colour != 0)
+                    slot = {colour, gb::Utils::get_bit(flags_byte, 4), gb::Utils::get_bit(flags_byte, 7)};
+            }
+        }
+        
+        // Function to mix a background and sprite pixel and draw it into the back frame, through the current pallettes
+        template <typename ppu_type>
+        void draw_pixel(ppu_type& ppu, uint8_t bg_pixel, sprite_pixel sprite){
+            const gb::lcd_registers& lcd = ppu.lcd;
+            
+            // If background rendering is disabled (LCDC bit 0 = 0), the background and window are blank
+            if (!lcd.background_enabled)
+                bg_pixel = 0;
+            
+            // The sprite pixel is drawn unless it is transparent, or has priority 1 and the background pixel is not 0
+            uint8_t shade;
+            if (sprite.colour == 0 or (sprite.priority and bg_pixel != 0))
+                shade = (lcd.bgp >> (bg_pixel * 2)) & 0b11;
+            else
+                shade = ((sprite.pallette ? lcd.obp1 : lcd.obp0) >> (sprite.colour * 2)) & 0b11;
+            
+            gb::frame& frame = ppu.frames.back();
+            int y = ppu.num_scanlines;
+            frame.shades[y][x] = shade;
+            if (ppu.output_rgba)
+                frame.rgba[160 * y + x] = ppu.host_pallette[shade];
+        }
+    };
+    
+    typedef ppu_core<gb::fifo_backend> fifo_ppu;
+}
+
+#endif /* FifoBackend_h */
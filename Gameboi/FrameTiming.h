@@ -0,0 +1,71 @@
+// Created by Niklas on 19/10/2026.
+// Class which measures the intervals between frames on one thread, to report frame time and jitter
+
+#ifndef FrameTiming_h
+#define FrameTiming_h
+
+#include <chrono>
+#include <cmath>
+#include <string>
+
+namespace gb {
+    class frame_timing {
+    public:
+        // Function to call once per frame - records the time since the previous call
+        void tick(){
+            auto now = std::chrono::steady_clock::now();
+            
+            if (has_last_tick) {
+                double interval = std::chrono::duration<double, std::milli>(now - last_tick).count();
+                total += interval;
+                total_squared += interval * interval;
+                if (interval > longest) longest = interval;
+                count++;
+            }
+            
+            last_tick = now;
+            has_last_tick = true;
+        }
+        
+        // Function to forget the previous tick, eg after pausing, so the gap is not counted as a frame
+        void restart(){
+            has_last_tick = false;
+        }
+        
+        // Function to clear all measurements
+        void reset(){
+            total = 0; total_squared = 0; longest = 0; count = 0;
+        }
+        
+        // Functions to get the number of frames measured, the average frame time and the worst frame time in ms
+        long frames() {return count;}
+        double average_ms() {return count ? total / count : 0;}
+        double longest_ms() {return longest;}
+        
+        // Function to get the jitter - the standard deviation of the frame time in ms
+        double jitter_ms(){
+            if (count == 0) return 0;
+            double average = average_ms();
+            return std::sqrt(std::fmax(0.0, total_squared / count - average * average));
+        }
+        
+        // Function to format the measurements as one line of text
+        std::string summary(){
+            return "avg " + std::to_string(average_ms()) + " ms, jitter " + std::to_string(jitter_ms()) +
+                   " ms, worst " + std::to_string(longest_ms()) + " ms";
+        }
+    
+    private:
+        // Stores the time of the last tick
+        std::chrono::steady_clock::time_point last_tick;
+        bool has_last_tick = false;
+        
+        // Stores the sum and sum of squares of the intervals, the longest interval and the number of intervals
+        double total = 0;
+        double total_squared = 0;
+        double longest = 0;
+        long count = 0;
+    };
+}
+
+#endif /* FrameTiming_h */
@@ -0,0 +1,131 @@
+// Created by Niklas on 19/10/2026.
+// Audio sink which writes the apu's mixed output to a WAV or raw PCM file, so sound can be captured without a sound
+// device and as fast as the emulation runs
+// Samples are written to disk on a writer thread (see BlockWriter.h), so the emulation does not wait for the disk - a
+// hash of every sample is also kept, for regression testing the audio
+
+#ifndef AudioFileSink_h
+#define AudioFileSink_h
+
+#include <cstdio>
+#include <string>
+
+#include "Sinks.h"
+#include "BlockWriter.h"
+
+namespace gb {
+    class audio_file_sink : public gb::audio_sink {
+    public:
+        // File formats - both hold 16 bit stereo samples, left then right, in the host's byte order (little endian
+        // on every platform the emulator runs on), and raw files have no header
+        enum format {WAV, RAW};
+        
+        // Constructor takes the path of the file to write, which is created when the apu starts the sink
+        audio_file_sink(std::string _path, format _file_format = WAV){
+            path = _path;
+            file_format = _file_format;
+        }
+        
+        // Destructor finishes writing the file
+        ~audio_file_sink(){
+            stop();
+        }
+        
+        // Function to open the file and start the writer thread
+        virtual void start(int _sample_rate){
+            stop();
+            sample_rate = _sample_rate;
+            frames_written = 0;
+            hash = 14695981039346656037ULL;
+            
+            file = std::fopen(path.c_str(), "wb");
+            opened = file != nullptr;
+            if (!file)
+                return;
+            
+            // The WAV header's sizes are filled in when the file is finished
+            if (file_format == WAV)
+                write_wav_header(0);
+            
+            writer.start(file);
+        }
+        
+        // Function to hand samples to the writer
+        virtual void push_samples(const int16_t* samples, size_t count){
+            if (!writer.is_running())
+                return;
+            
+            // FNV-1a hash of every sample
+            for (size_t i = 0; i < 2 * count; i++)
+                hash = (hash ^ (uint16_t)samples[i]) * 1099511628211ULL;
+            
+            writer.push(samples, 2 * count);
+            frames_written += count;
+        }
+        
+        // Function to write the last samples and finish the file
+        virtual void stop(){
+            if (!writer.is_running())
+                return;
+            
+            writer.stop();
+            
+            if (file_format == WAV) {
+                std::fseek(file, 0, SEEK_SET);
+                write_wav_header((uint32_t)(frames_written * 4));
+            }
+            std::fclose(file);
+            file = nullptr;
+        }
+        
+        // Function to check whether the file could be opened when the sink was started
+        bool was_opened(){
+            return opened;
+        }
+        
+        // Functions to get the number of stereo samples written, and the hash of all of them
+        size_t get_frames_written(){
+            return frames_written;
+        }
+        
+        uint64_t get_hash(){
+            return hash;
+        }
+    
+    private:
+        // Stores the file's path, format and sample rate, and the file while it is open
+        std::string path;
+        format file_format;
+        int sample_rate = 44100;
+        FILE* file = nullptr;
+        bool opened = false;
+        
+        // Stores the number of stereo samples written and the hash of all samples
+        size_t frames_written = 0;
+        uint64_t hash = 14695981039346656037ULL;
+        
+        // Writes the samples on its own thread, in blocks of about 0.75 s of sound at 44100 Hz
+        gb::block_writer<int16_t> writer{65536};
+        
+        // Function to write a 44 byte WAV header for 16 bit stereo PCM with the given number of bytes of samples
+        void write_wav_header(uint32_t data_bytes){
+            auto write_32 = [this](uint32_t value){ std::fwrite(&value, 4, 1, file); };
+            auto write_16 = [this](uint16_t value){ std::fwrite(&value, 2, 1, file); };
+            
+            std::fputs("RIFF", file);
+            write_32(36 + data_bytes);
+            std::fputs("WAVEfmt ", file);
+            write_32(16);
+            write_16(1);
+            write_16(2);
+            write_32(sample_rate);
+            write_32(sample_rate * 4);
+            write_16(4);
+            write_16(16);
+            std::fputs("data", file);
+            write_32(data_bytes);
+        }
+    };
+}
+
+#endif /* AudioFileSink_h */
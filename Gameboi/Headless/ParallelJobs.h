@@ -0,0 +1,33 @@
+// Created by Niklas on 19/10/2026.
+// Function which spreads independent jobs, eg running one rom each, over one thread per core
+// Used by the headless runners - every job must only use its own emulator
+
+#ifndef ParallelJobs_h
+#define ParallelJobs_h
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+namespace gb {
+    // Function to call job(i) for every i from 0 to num_jobs - 1, with each thread taking the next job not yet started
+    inline void run_parallel(size_t num_jobs, std::function<void(size_t)> job){
+        std::atomic<size_t> next_job{0};
+        std::vector<std::thread> workers;
+        
+        unsigned num_threads = std::min((unsigned)num_jobs, std::max(1u, std::thread::hardware_concurrency()));
+        for (unsigned i = 0; i < num_threads; i++){
+            workers.emplace_back([&](){
+                for (size_t j = next_job++; j < num_jobs; j = next_job++)
+                    job(j);
+            });
+        }
+        
+        for (std::thread& worker: workers)
+            worker.join();
+    }
+}
+
+#endif /* ParallelJobs_h */
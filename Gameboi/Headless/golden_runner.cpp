@@ -0,0 +1,367 @@
+// Created by Niklas on 19/10/2026.
+// Regression check which runs the game roms in Roms/ headless with scripted inputs, and compares the frame hashes at
+// fixed frames against the golden hashes checked in to Headless/Golden/golden_hashes.txt
+// Frames which do not match are written as PGM images, and the runner exits with 1 if any frame did not match or a rom
+// has no golden hashes
+// Run from the repository folder: golden_runner [--update] [--dump <folder>] [--variants] [rom name ...]
+// With no rom names, every rom in Roms/ is run. --update writes the hashes of this build as the new golden hashes - the
+// golden hashes file is never written without it
+// --variants checks variants of the emulation against the reference emulation (the serial scanline renderer drawing
+// every frame) instead of the golden hashes - after every frame, frame skip must leave the cpu registers and memory the
+// same, and parallel rendering and the pixel FIFO backend must draw the same frame
+// The pixel FIFO backend draws some games differently, eg mid scanline effects - Headless/Golden/fifo_differences.txt
+// lists the first frame which differs for those roms, and every frame before it must still match
+// Built as the golden_runner target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -pthread -I. -IAudio -IBusDevices -IMappers -IHeadless Headless/golden_runner.cpp instructions.cpp -o golden_runner
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <memory>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+#include "EmulationController.h"
+#include "FifoBackend.h"
+#include "InputReplay.h"
+#include "ParallelJobs.h"
+
+// Paths to the golden hashes and the scripted inputs, relative to the repository folder
+const std::string golden_path = "Gameboi/Headless/Golden/golden_hashes.txt";
+const std::string inputs_path = "Gameboi/Headless/Golden/inputs.txt";
+const std::string fifo_differences_path = "Gameboi/Headless/Golden/fifo_differences.txt";
+
+// Frames which are hashed when a rom's golden hashes are updated
+const std::vector<long> default_checkpoints = {300, 600, 900, 1200, 1500, 1800, 2100, 2400, 2700, 3000, 3300, 3600};
+
+// Frames each rom runs for when checking variants, the frame skip used by the frame skip variant, and the workers used by
+// the parallel rendering variant
+const long variant_frames = 1800;
+const int variant_frame_skip = 3;
+const int variant_render_threads = 4;
+
+// Video sink which keeps a copy of the last frame it was given
+class CopyingVideoSink : public gb::video_sink {
+public:
+    std::unique_ptr<gb::frame> last_frame{new gb::frame()};
+    
+    virtual void present_frame(const gb::frame& frame){
+        std::memcpy(last_frame->shades, frame.shades, sizeof(frame.shades));
+        std::memcpy(last_frame->row_hashes, frame.row_hashes, sizeof(frame.row_hashes));
+    }
+};
+
+// Stores the outcome of running one rom - the hash of each checkpoint frame, and the checkpoints which did not match
+struct GoldenResult {
+    std::map<long, uint64_t> hashes;
+    std::vector<std::string> mismatches;
+    double host_seconds = 0;
+};
+
+// Stores the outcome of checking the variants of one rom - the first difference found in each variant, and notes which
+// do not fail the check
+struct VariantResult {
+    std::vector<std::string> differences;
+    std::vector<std::string> notes;
+    double host_seconds = 0;
+};
+
+// Stores one gameboy running a rom with the scripted inputs and no save file, for comparing variants of the emulation
+template <typename ppu_type>
+struct Machine {
+    gb::cpu cpu; ppu_type ppu; gb::bus bus; gb::apu apu;
+    CopyingVideoSink video;
+    gb::input_replay replay;
+    
+    // Declared after the hardware components, so it is destroyed first
+    EmulationController<ppu_type> emulator{&cpu, &bus, &ppu, &apu, "Roms/", ""};
+    
+    Machine(std::string rom_name){
+        apu.synthesis = false;
+        replay.load(inputs_path);
+        emulator.video = &video;
+        emulator.input = &replay;
+        emulator.init("Files/bios.bin");
+        emulator.load_rom(rom_name);
+    }
+};
+
+// Function to hash the cpu registers and the memory from 8000 - FFFF, which do not depend on how frames are drawn
+uint64_t hash_state(gb::cpu& cpu, gb::bus& bus){
+    uint64_t hash = 0;
+    for (uint16_t reg: {cpu.AF(), cpu.BC(), cpu.DE(), cpu.HL(), cpu.SP, cpu.PC})
+        hash = hash * 31 + reg;
+    for (int addr = 0x8000; addr <= 0xFFFF; addr++)
+        hash = hash * 31 + bus.read(addr);
+    
+    return hash;
+}
+
+// Function to write a frame's shades as a greyscale PGM image
+void write_pgm(const gb::frame& frame, std::string path){
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    file << "P5\n160 144\n255\n";
+    
+    const uint8_t greys[4] = {255, 170, 85, 0};
+    for (int y = 0; y < 144; y++)
+        for (int x = 0; x < 160; x++)
+            file.put(greys[frame.shades[y][x] & 0b11]);
+}
+
+// Function to run a rom up to its last checkpoint, hashing the checkpoint frames and comparing them with the golden hashes
+GoldenResult run_rom(std::string rom_name, const std::map<long, uint64_t>& golden, std::string dump_folder){
+    gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
+    apu.synthesis = false;
+    
+    // No saves folder, so cartridge ram always starts cleared and is never saved
+    EmulationController emulator(&cpu, &bus, &ppu, &apu, "Roms/", "");
+    
+    CopyingVideoSink video;
+    gb::input_replay replay;
+    replay.load(inputs_path);
+    emulator.video = &video;
+    emulator.input = &replay;
+    
+    // Only the checkpoint frames are drawn
+    emulator.frame_skip = 1 << 30;
+    
+    emulator.init("Files/bios.bin");
+    emulator.load_rom(rom_name);
+    
+    std::vector<long> checkpoints = default_checkpoints;
+    if (!golden.empty()) {
+        checkpoints.clear();
+        for (const auto& entry: golden)
+            checkpoints.push_back(entry.first);
+    }
+    
+    GoldenResult result;
+    auto start = std::chrono::steady_clock::now();
+    size_t next_checkpoint = 0;
+    
+    for (long frame = 1; next_checkpoint < checkpoints.size(); frame++){
+        bool checkpoint = frame == checkpoints[next_checkpoint];
+        emulator.emulate_frame(checkpoint);
+        if (!checkpoint)
+            continue;
+        
+        next_checkpoint++;
+        uint64_t hash = gb::hash_frame(*video.last_frame);
+        result.hashes[frame] = hash;
+        
+        auto expected = golden.find(frame);
+        if (expected == golden.end() or expected->second == hash)
+            continue;
+        
+        std::ostringstream mismatch;
+        mismatch << "frame " << frame << ": expected " << std::hex << std::setw(16) << std::setfill('0') << expected->second
+                 << ", got " << std::setw(16) << hash;
+        
+        // The dump folder is only created once a frame does not match
+        if (!dump_folder.empty()) {
+            std::error_code error;
+            std::filesystem::create_directories(dump_folder, error);
+            
+            std::string path = dump_folder + "/" + rom_name + "_" + std::to_string(frame) + ".pgm";
+            write_pgm(*video.last_frame, path);
+            mismatch << " (written to " << path << ")";
+        }
+        
+        result.mismatches.push_back(mismatch.str());
+    }
+    
+    result.host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Function to run a rom alongside variants of its emulation, comparing them with the reference emulation after every frame
+// The pixel FIFO backend is only compared up to fifo_frames, the first frame it is known to draw differently
+VariantResult run_variants(std::string rom_name, long fifo_frames){
+    // Frame skip only stops frames being drawn, so it must not change the cpu registers or memory
+    std::unique_ptr<Machine<gb::ppu>> reference(new Machine<gb::ppu>(rom_name));
+    std::unique_ptr<Machine<gb::ppu>> skipping(new Machine<gb::ppu>(rom_name));
+    skipping->emulator.frame_skip = variant_frame_skip;
+    
+    // Parallel rendering draws each frame from a log of the scanlines, and the pixel FIFO backend draws pixels during
+    // mode 3 - both must draw the same frames as the serial renderer
+    std::unique_ptr<Machine<gb::ppu>> parallel(new Machine<gb::ppu>(rom_name));
+    parallel->ppu.parallel_rendering = true;
+    parallel->ppu.render_threads = variant_render_threads;
+    std::unique_ptr<Machine<gb::fifo_ppu>> fifo(new Machine<gb::fifo_ppu>(rom_name));
+    
+    VariantResult result;
+    auto start = std::chrono::steady_clock::now();
+    bool skipping_matches = true, parallel_matches = true, fifo_matches = true;
+    
+    // Function to record the first difference found in a variant
+    auto add_difference = [&result](bool& matches, std::string description, long frame){
+        if (matches)
+            result.differences.push_back(description + " at frame " + std::to_string(frame));
+        matches = false;
+    };
+    
+    for (long frame = 1; frame <= variant_frames and (skipping_matches or parallel_matches or fifo_matches); frame++){
+        reference->emulator.emulate_frame();
+        skipping->emulator.emulate_frame();
+        parallel->emulator.emulate_frame();
+        if (fifo_matches)
+            fifo->emulator.emulate_frame();
+        
+        uint64_t state = hash_state(reference->cpu, reference->bus);
+        if (hash_state(skipping->cpu, skipping->bus) != state)
+            add_difference(skipping_matches, "frame skip " + std::to_string(variant_frame_skip) + ": cpu registers or memory differ", frame);
+        
+        uint64_t hash = gb::hash_frame(*reference->video.last_frame);
+        if (gb::hash_frame(*parallel->video.last_frame) != hash)
+            add_difference(parallel_matches, "parallel rendering: frame differs", frame);
+        if (!fifo_matches)
+            continue;
+        
+        bool fifo_differs = gb::hash_frame(*fifo->video.last_frame) != hash;
+        if (fifo_differs and frame < fifo_frames)
+            add_difference(fifo_matches, "pixel FIFO backend: frame differs (known first difference is frame "
+                           + std::to_string(fifo_frames) + ")", frame);
+        
+        // Stops comparing at the known first difference
+        if (frame == fifo_frames) {
+            if (!fifo_differs)
+                result.notes.push_back("pixel FIFO backend: frame " + std::to_string(frame) + " now matches, update the known differences");
+            fifo_matches = false;
+        }
+    }
+    
+    result.host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+int main(int argc, const char** argv) {
+    bool update = false;
+    bool variants = false;
+    std::string dump_folder = "golden_failures";
+    std::vector<std::string> roms;
+    
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (strcmp(argv[i], "--dump") == 0 and i + 1 < argc)
+            dump_folder = argv[++i];
+        else if (strcmp(argv[i], "--variants") == 0)
+            variants = true;
+        else
+            roms.push_back(argv[i]);
+    }
+    
+    if (roms.empty()) {
+        for (const auto& entry: std::filesystem::directory_iterator("Roms"))
+            if (entry.path().extension() == ".gb")
+                roms.push_back(entry.path().stem().string());
+        std::sort(roms.begin(), roms.end());
+    }
+    
+    // Checks the variants of each rom's emulation on one thread per core
+    if (variants) {
+        // Reads the first frame the pixel FIFO backend draws differently - each line is "<rom name> <frame>"
+        std::map<std::string, long> fifo_differences;
+        std::ifstream differences_file(fifo_differences_path);
+        std::string line;
+        while (std::getline(differences_file, line)) {
+            std::istringstream fields(line);
+            std::string rom;
+            long frame;
+            if (line.empty() or line[0] == '#' or !(fields >> rom >> frame))
+                continue;
+            
+            fifo_differences[rom] = frame;
+        }
+        
+        std::vector<VariantResult> results(roms.size());
+        gb::run_parallel(roms.size(), [&](size_t i){
+            auto difference = fifo_differences.find(roms[i]);
+            results[i] = run_variants(roms[i], difference == fifo_differences.end() ? variant_frames + 1 : difference->second);
+        });
+        
+        int failed = 0;
+        for (size_t i = 0; i < roms.size(); i++){
+            const VariantResult& result = results[i];
+            std::cout << std::left << std::setw(16) << roms[i] << std::setw(12) << (result.differences.empty() ? "OK" : "DIFFERS")
+                      << std::right << std::fixed << std::setprecision(2) << std::setw(8) << result.host_seconds << " s" << std::endl;
+            
+            for (const std::string& difference: result.differences)
+                std::cout << "    " << difference << std::endl;
+            for (const std::string& note: result.notes)
+                std::cout << "    " << note << std::endl;
+            
+            failed += !result.differences.empty();
+        }
+        
+        std::cout << roms.size() - failed << " / " << roms.size() << " roms matched their variants" << std::endl;
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
+    // Reads the golden hashes - each line is "<rom name> <frame> <hash>"
+    std::map<std::string, std::map<long, uint64_t>> golden;
+    std::ifstream golden_file(golden_path);
+    std::string line;
+    while (std::getline(golden_file, line)) {
+        std::istringstream fields(line);
+        std::string rom, hash;
+        long frame;
+        if (line.empty() or line[0] == '#' or !(fields >> rom >> frame >> hash))
+            continue;
+        
+        golden[rom][frame] = std::stoull(hash, nullptr, 16);
+    }
+    golden_file.close();
+    
+    // Runs the roms on one thread per core - when updating, the golden hashes are not compared, and otherwise roms with
+    // no golden hashes are not run
+    std::vector<GoldenResult> results(roms.size());
+    const std::map<long, uint64_t> no_hashes;
+    gb::run_parallel(roms.size(), [&](size_t i){
+        auto hashes = golden.find(roms[i]);
+        if (update)
+            results[i] = run_rom(roms[i], no_hashes, "");
+        else if (hashes != golden.end())
+            results[i] = run_rom(roms[i], hashes->second, dump_folder);
+    });
+    
+    int failed = 0;
+    for (size_t i = 0; i < roms.size(); i++){
+        const GoldenResult& result = results[i];
+        bool is_new = golden.count(roms[i]) == 0;
+        
+        std::string status = update ? "UPDATED" : is_new ? "NO HASHES" : result.mismatches.empty() ? "OK" : "MISMATCH";
+        std::cout << std::left << std::setw(16) << roms[i] << std::setw(12) << status << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(8) << result.host_seconds << " s" << std::endl;
+        
+        for (const std::string& mismatch: result.mismatches)
+            std::cout << "    " << mismatch << std::endl;
+        
+        // A rom with no golden hashes fails until they are added with --update
+        if (!update and is_new)
+            std::cout << "    no golden hashes, run with --update to add them" << std::endl;
+        
+        failed += !result.mismatches.empty() or (!update and is_new);
+        
+        if (update)
+            golden[roms[i]] = result.hashes;
+    }
+    
+    // Writes this build's hashes as the golden hashes of the roms which were run
+    if (update) {
+        std::ofstream output(golden_path, std::ios::out | std::ios::trunc);
+        output << "# Golden frame hashes for golden_runner - <rom name> <frame> <hash of the frame's shades (gb::hash_frame)>\n";
+        for (const auto& rom: golden)
+            for (const auto& entry: rom.second)
+                output << rom.first << " " << entry.first << " " << std::hex << std::setw(16) << std::setfill('0')
+                       << entry.second << std::dec << std::setfill(' ') << "\n";
+    }
+    
+    std::cout << roms.size() - failed << " / " << roms.size() << " roms matched" << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Created by Niklas on 19/10/2026.
+// Headless runner which emulates a rom for a number of frames without a window or sound device, and prints a hash of
+// the last frame - only uses the emulator core, so it builds without SFML
+// With --audio, the sound is written to a WAV file (or raw PCM if the path ends in .raw) and its hash is printed too
+// With --vgm, every write to the sound registers is recorded in a VGM file
+// Run from the repository folder: headless <rom name> <frames> [bios path] [--audio <path>] [--vgm <path>],
+// eg headless tetris 3600
+// Built as the headless target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -pthread -I. -IAudio -IBusDevices -IMappers Headless/main.cpp instructions.cpp -o headless
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+#include "EmulationController.h"
+#include "Sinks.h"
+#include "AudioFileSink.h"
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: headless <rom name> <frames> [bios path] [--audio <path>] [--vgm <path>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    int frames = std::atoi(argv[2]);
+    std::string bios_path = "Files/bios.bin";
+    std::string audio_path;
+    std::string vgm_path;
+    
+    for (int i = 3; i < argc; i++){
+        if (std::string(argv[i]) == "--audio" and i + 1 < argc)
+            audio_path = argv[++i];
+        else if (std::string(argv[i]) == "--vgm" and i + 1 < argc)
+            vgm_path = argv[++i];
+        else
+            bios_path = argv[i];
+    }
+    
+    // Initialise main hardware components - without an audio file, the apu does not synthesise sound
+    gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
+    EmulationController emulator(&cpu, &bus, &ppu, &apu, "Roms/", "Saves/");
+    
+    bool raw_audio = audio_path.size() > 4 and audio_path.substr(audio_path.size() - 4) == ".raw";
+    gb::audio_file_sink audio(audio_path, raw_audio ? gb::audio_file_sink::RAW : gb::audio_file_sink::WAV);
+    if (audio_path.empty())
+        apu.synthesis = false;
+    else
+        apu.connect_audio(&audio);
+    
+    gb::hashing_video_sink video;
+    emulator.video = &video;
+    
+    emulator.init(bios_path);
+    emulator.load_rom(argv[1]);
+    
+    // The VGM logger is started after the apu, so it records the registers from power on
+    gb::vgm_logger vgm(vgm_path);
+    if (!vgm_path.empty()) {
+        vgm.start(bus.clock);
+        apu.connect_vgm_logger(&vgm);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    for (int i = 0; i < frames; i++)
+        emulator.emulate_frame();
+    apu.stop_all();
+    apu.connect_vgm_logger(nullptr);
+    vgm.stop(bus.clock);
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << "Frames: " << frames << ", frames presented: " << video.frames << std::endl;
+    std::cout << "Time: " << std::fixed << std::setprecision(3) << seconds << " s, " << std::setprecision(1)
+              << frames / seconds << " fps" << std::endl;
+    std::cout << "Last frame hash: " << std::hex << std::setw(16) << std::setfill('0') << video.last_hash << std::endl;
+    
+    if (!audio_path.empty()) {
+        if (!audio.was_opened()) {
+            std::cerr << "Could not write audio file " << audio_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << std::dec << "Audio: " << audio.get_frames_written() << " samples written to " << audio_path
+                  << ", hash " << std::hex << std::setw(16) << audio.get_hash() << std::endl;
+    }
+    
+    if (!vgm_path.empty()) {
+        if (!vgm.was_opened()) {
+            std::cerr << "Could not write VGM file " << vgm_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << std::dec << "VGM: " << vgm.get_writes_logged() << " register writes logged to " << vgm_path << std::endl;
+    }
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+// Created by Niklas on 19/10/2026.
+// Runs the test roms in Roms/Tests headless, and reads whether each passed from the text it sends through the serial port
+// Roms run in parallel, each for at most a budget of emulated seconds, and the runner exits with 1 if any did not give
+// its expected result - roms listed in Headless/Golden/expected_test_results.txt are known not to pass yet, and all
+// others are expected to pass
+// Before the roms, register traces are played into the apu alone, checking when its channels turn on and off, and the
+// ppu alone is checked turning the LCD off mid frame
+// Run from the repository folder: test_runner [budget in emulated seconds] [rom name ...], eg test_runner 120 test_01
+// With no rom names, every rom in Roms/Tests is run
+// Built as the test_runner target by CMakeLists.txt in the repository folder, or from the Gameboi folder, eg:
+// g++ -std=c++17 -O2 -pthread -I. -IAudio -IBusDevices -IMappers Headless/test_runner.cpp instructions.cpp -o test_runner
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+
+#include "EmulationController.h"
+#include "ParallelJobs.h"
+
+// Path to the expected results of the test roms which do not pass yet, relative to the repository folder
+const std::string expected_results_path = "Gameboi/Headless/Golden/expected_test_results.txt";
+
+// Stores the outcome of running one test rom
+struct TestResult {
+    enum {PASSED, FAILED, TIMED_OUT} status = TIMED_OUT;
+    double emulated_seconds = 0;
+    double host_seconds = 0;
+    std::string output;
+};
+
+// Stores a register trace for the apu - registers are written at set clocks, and the channel bits of NR52 (bit 0 - 3 =
+// square 1, square 2, wave, noise playing) are checked against expected values at others
+// The frame sequencer first steps 8192 clocks in, so length counters are clocked at 8192, 24576, 40960, ... and the
+// frequency sweep at 24576, 57344, ...
+struct ApuTrace {
+    struct Step {
+        int clock;
+        uint16_t addr;
+        uint8_t value;
+    };
+    
+    // Steps with an address of 0 are checks, whose value is the expected channel bits
+    static const uint16_t CHECK = 0;
+    
+    std::string name;
+    std::vector<Step> steps;
+};
+
+const std::vector<ApuTrace> apu_traces = {
+    {"square 1 length", {
+        {0, 0xFF26, 0x80}, {0, 0xFF12, 0xF0}, {0, 0xFF11, 0x3E}, {0, 0xFF14, 0xC0},
+        {100, ApuTrace::CHECK, 0x1}, {24000, ApuTrace::CHECK, 0x1}, {24600, ApuTrace::CHECK, 0x0}
+    }},
+    {"square 2 unlimited", {
+        {0, 0xFF26, 0x80}, {0, 0xFF17, 0xF0}, {0, 0xFF16, 0x3F}, {0, 0xFF19, 0x80},
+        {100, ApuTrace::CHECK, 0x2}, {70000, ApuTrace::CHECK, 0x2}
+    }},
+    {"wave length", {
+        {0, 0xFF26, 0x80}, {0, 0xFF1A, 0x80}, {0, 0xFF1B, 0xFE}, {0, 0xFF1E, 0xC0},
+        {100, ApuTrace::CHECK, 0x4}, {24000, ApuTrace::CHECK, 0x4}, {24600, ApuTrace::CHECK, 0x0}
+    }},
+    {"wave dac off", {
+        {0, 0xFF26, 0x80}, {0, 0xFF1A, 0x80}, {0, 0xFF1E, 0x80},
+        {100, ApuTrace::CHECK, 0x4}, {1000, 0xFF1A, 0x00}, {1100, ApuTrace::CHECK, 0x0}
+    }},
+    {"noise dac off", {
+        {0, 0xFF26, 0x80}, {0, 0xFF21, 0xF0}, {0, 0xFF23, 0x80},
+        {100, ApuTrace::CHECK, 0x8}, {1000, 0xFF21, 0x00}, {1100, ApuTrace::CHECK, 0x0}
+    }},
+    {"sweep overflow", {
+        {0, 0xFF26, 0x80}, {0, 0xFF10, 0x11}, {0, 0xFF12, 0xF0}, {0, 0xFF13, 0x00}, {0, 0xFF14, 0x85},
+        {100, ApuTrace::CHECK, 0x1}, {24000, ApuTrace::CHECK, 0x1}, {24600, ApuTrace::CHECK, 0x0}
+    }},
+    {"sweep trigger overflow", {
+        {0, 0xFF26, 0x80}, {0, 0xFF10, 0x11}, {0, 0xFF12, 0xF0}, {0, 0xFF13, 0xFF}, {0, 0xFF14, 0x86},
+        {100, ApuTrace::CHECK, 0x0}
+    }},
+    {"power off", {
+        {0, 0xFF26, 0x80}, {0, 0xFF17, 0xF0}, {0, 0xFF19, 0x80}, {0, 0xFF21, 0xF0}, {0, 0xFF23, 0x80},
+        {100, ApuTrace::CHECK, 0xA}, {1000, 0xFF26, 0x00}, {1100, ApuTrace::CHECK, 0x0}
+    }},
+};
+
+// Function to play a register trace into the apu, returning a message for each check which failed
+std::vector<std::string> run_apu_trace(const ApuTrace& trace){
+    gb::bus bus; gb::apu apu;
+    apu.connect_bus(&bus);
+    apu.synthesis = false;
+    apu.init();
+    
+    std::vector<std::string> failures;
+    int clock = 0;
+    
+    for (const ApuTrace::Step& step: trace.steps) {
+        // Runs the apu as if after a series of 1 cycle instructions
+        for (; clock < step.clock; clock += 4)
+            apu.run(4);
+        
+        if (step.addr != ApuTrace::CHECK) {
+            bus.write(step.addr, step.value);
+            apu.run(0);
+            continue;
+        }
+        
+        int channels = bus.read(0xFF26) & 0x0F;
+        if (channels != step.value)
+            failures.push_back("at clock " + std::to_string(step.clock) + " channel bits are " + std::to_string(channels)
+                               + ", expected " + std::to_string(step.value));
+    }
+    
+    return failures;
+}
+
+// Function to check that turning the LCD off mid frame resets the ppu, so LY reads 0 and STAT reads mode 0 until it is
+// turned back on (dr_mario waits for mode 0 with the LCD off), returning a message for each check which failed
+std::vector<std::string> run_lcd_off_check(){
+    gb::bus bus; gb::ppu ppu;
+    ppu.connect_bus(&bus);
+    ppu.init();
+    ppu.render_frame = false;
+    
+    // Runs with the LCD on until line 50 is being drawn (mode 3)
+    bus.write(0xFF40, 0x91);
+    int cycles = 0;
+    while (!(bus.read(0xFF44) == 50 and (bus.read(0xFF41) & 0b11) == 3) and cycles < 70224 / 4) {
+        ppu.do_cycle();
+        cycles++;
+    }
+    
+    std::vector<std::string> failures;
+    if (cycles == 70224 / 4)
+        failures.push_back("line 50 was never drawn with the LCD on");
+    
+    // Turns the LCD off, then runs for a whole frame
+    bus.write(0xFF40, 0x11);
+    for (int i = 0; i < 70224 / 4; i++)
+        ppu.do_cycle();
+    
+    if (bus.read(0xFF44) != 0)
+        failures.push_back("LY is " + std::to_string(bus.read(0xFF44)) + " with the LCD off, expected 0");
+    if ((bus.read(0xFF41) & 0b11) != 0)
+        failures.push_back("STAT mode is " + std::to_string(bus.read(0xFF41) & 0b11) + " with the LCD off, expected 0");
+    
+    return failures;
+}
+
+// Function to run one test rom until it prints Passed or Failed, or the budget runs out
+TestResult run_test(std::string rom_name, double budget_seconds){
+    gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
+    apu.synthesis = false;
+    EmulationController emulator(&cpu, &bus, &ppu, &apu, "Roms/Tests/", "Saves/");
+    emulator.init("Files/bios.bin");
+    emulator.load_rom(rom_name);
+    
+    // The screen is not checked, so frames are never drawn
+    emulator.frame_skip = 1 << 30;
+    
+    TestResult result;
+    auto start = std::chrono::steady_clock::now();
+    const long long budget_cycles = budget_seconds * CLOCK_SPEED;
+    
+    // Frames left to run once a result is printed, so the rest of the message is captured too
+    int frames_left = -1;
+    
+    while (emulator.total_cycles < budget_cycles and frames_left != 0) {
+        emulator.emulate_frame();
+        
+        if (frames_left > 0) {
+            frames_left--;
+            continue;
+        }
+        
+        const std::string& output = bus.get_serial_output();
+        if (output.find("Passed") != std::string::npos or output.find("Failed") != std::string::npos) {
+            result.status = output.find("Failed") == std::string::npos ? TestResult::PASSED : TestResult::FAILED;
+            result.emulated_seconds = emulator.total_cycles / CLOCK_SPEED;
+            frames_left = 10;
+        }
+    }
+    
+    if (result.status == TestResult::TIMED_OUT)
+        result.emulated_seconds = emulator.total_cycles / CLOCK_SPEED;
+    
+    result.host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.output = bus.get_serial_output();
+    return result;
+}
+
+int main(int argc, const char** argv) {
+    double budget_seconds = argc > 1 ? std::atof(argv[1]) : 120;
+    
+    std::vector<std::string> roms;
+    for (int i = 2; i < argc; i++)
+        roms.push_back(argv[i]);
+    
+    if (roms.empty()) {
+        for (const auto& entry: std::filesystem::directory_iterator("Roms/Tests"))
+            if (entry.path().extension() == ".gb")
+                roms.push_back(entry.path().stem().string());
+        std::sort(roms.begin(), roms.end());
+    }
+    
+    if (budget_seconds <= 0 or roms.empty()) {
+        std::cerr << "Usage: test_runner [budget in emulated seconds] [rom name ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    // Plays the apu register traces first, which take no time
+    const char* status_names[3] = {"PASSED", "FAILED", "TIMED OUT"};
+    size_t traces_passed = 0;
+    
+    std::cout << std::left << std::setw(28) << "Apu trace" << "Result" << std::endl;
+    for (const ApuTrace& trace: apu_traces){
+        std::vector<std::string> failures = run_apu_trace(trace);
+        traces_passed += failures.empty();
+        
+        std::cout << std::left << std::setw(28) << trace.name << status_names[failures.empty() ? 0 : 1] << std::endl;
+        for (const std::string& failure: failures)
+            std::cout << "    " << failure << std::endl;
+    }
+    std::cout << traces_passed << " / " << apu_traces.size() << " apu traces passed" << std::endl << std::endl;
+    
+    std::vector<std::string> lcd_off_failures = run_lcd_off_check();
+    std::cout << std::left << std::setw(28) << "Ppu LCD off" << status_names[lcd_off_failures.empty() ? 0 : 1] << std::endl;
+    for (const std::string& failure: lcd_off_failures)
+        std::cout << "    " << failure << std::endl;
+    std::cout << std::endl;
+    
+    // Reads the expected results of the roms which do not pass yet - each line is "<rom name> <FAILED or TIMED_OUT>"
+    std::map<std::string, int> expected;
+    std::ifstream expected_file(expected_results_path);
+    std::string line;
+    while (std::getline(expected_file, line)) {
+        std::istringstream fields(line);
+        std::string rom, status;
+        if (line.empty() or line[0] == '#' or !(fields >> rom >> status))
+            continue;
+        
+        expected[rom] = status == "TIMED_OUT" ? TestResult::TIMED_OUT : TestResult::FAILED;
+    }
+    
+    // Runs the roms on one thread per core
+    std::vector<TestResult> results(roms.size());
+    
+    auto start = std::chrono::steady_clock::now();
+    gb::run_parallel(roms.size(), [&](size_t rom){
+        results[rom] = run_test(roms[rom], budget_seconds);
+    });
+    
+    double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    // Prints a line for each rom, with the serial output of any which did not pass
+    int passed = 0;
+    int unexpected = 0;
+    
+    std::cout << std::left << std::setw(16) << "Rom" << std::setw(12) << "Result" << std::right << std::setw(16) << "Emulated s"
+              << std::setw(12) << "Host s" << std::endl;
+    
+    for (size_t i = 0; i < roms.size(); i++){
+        const TestResult& result = results[i];
+        passed += result.status == TestResult::PASSED;
+        
+        // A known failure which now passes is reported, but is not a failure
+        auto known = expected.find(roms[i]);
+        int expected_status = known == expected.end() ? TestResult::PASSED : known->second;
+        bool as_expected = result.status == expected_status or result.status == TestResult::PASSED;
+        unexpected += !as_expected;
+        
+        std::cout << std::left << std::setw(16) << roms[i] << std::setw(12) << status_names[result.status] << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(16) << result.emulated_seconds
+                  << std::setw(12) << result.host_seconds;
+        if (known != expected.end())
+            std::cout << (result.status == TestResult::PASSED ? "    passes now, remove it from the expected results"
+                          : as_expected ? "    known failure" : "    expected " + std::string(status_names[expected_status]));
+        std::cout << std::endl;
+        
+        if (result.status != TestResult::PASSED)
+            std::cout << "    Serial output: " << result.output << std::endl;
+    }
+    
+    std::cout << passed << " / " << roms.size() << " passed in " << std::setprecision(2) << total_seconds << " s, "
+              << unexpected << " unexpected results" << std::endl;
+    return unexpected == 0 and traces_passed == apu_traces.size() and lcd_off_failures.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,79 @@
+// Created by Niklas on 19/10/2026.
+// Input source which replays button states recorded in a text file, so runs of a rom can be repeated exactly
+// Each line is "<frame> <button states>", setting the button states (bit 0 - 7 = a, b, up, down, left, right, start,
+// select) from that frame onwards - eg "120 0x40" presses start at frame 120. Lines starting with # are comments
+
+#ifndef InputReplay_h
+#define InputReplay_h
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Sinks.h"
+
+namespace gb {
+    class input_replay : public gb::input_source {
+    public:
+        // Function to load a replay file - returns false if it could not be read
+        bool load(std::string path){
+            std::ifstream file(path);
+            if (!file.is_open())
+                return false;
+            
+            events.clear();
+            std::string line;
+            while (std::getline(file, line)) {
+                if (line.empty() or line[0] == '#')
+                    continue;
+                
+                std::istringstream fields(line);
+                long frame;
+                std::string states;
+                if (fields >> frame >> states)
+                    events.push_back({frame, (uint8_t)std::stoi(states, nullptr, 0)});
+            }
+            
+            // Keeps lines for the same frame in file order
+            std::stable_sort(events.begin(), events.end(), [](const event& a, const event& b){return a.frame < b.frame;});
+            
+            rewind();
+            return true;
+        }
+        
+        // Function to start replaying from the first frame again
+        void rewind(){
+            frame = 0;
+            next_event = 0;
+            key_states = 0;
+        }
+        
+        // Function called before each frame - returns the button states for that frame
+        virtual uint8_t get_key_states(){
+            while (next_event < events.size() and events[next_event].frame <= frame)
+                key_states = events[next_event++].states;
+            
+            frame++;
+            return key_states;
+        }
+    
+    private:
+        // Stores a change of button states
+        struct event {
+            long frame;
+            uint8_t states;
+        };
+        
+        // Stores all changes, in order of frame
+        std::vector<event> events;
+        
+        // Stores the next frame number, the next change to apply and the current button states
+        long frame = 0;
+        size_t next_event = 0;
+        uint8_t key_states = 0;
+    };
+}
+
+#endif /* InputReplay_h */
@@ -31,7 +31,7 @@ namespace gb {
             ram.reserve(ram_size);
             
             // If there is a battery, loads the contents of battery backed ram from saves file
-            if (has_battery) {
+            if (has_battery and !memory_path.empty()) {
                 std::ifstream input_file;
                 input_file.open(memory_path, std::ios::in | std::ios::binary);
                 
@@ -42,11 +42,14 @@ namespace gb {
                 
                 input_file.close();
             }
+            
+            // Fills any ram not loaded from a saves file with zeros
+            ram.resize(ram_size, 0);
         }
         
         void close() {
             // If there is a battery, saves the contents of battery backed ram to save file
-            if (has_battery) {
+            if (has_battery and !memory_path.empty()) {
                 std::ofstream output_file;
                 output_file.open(memory_path, std::ios::out | std::ios::binary | std::ios::trunc);
                 
@@ -15,7 +15,7 @@ namespace gb {
         // Stores whether the cartridge has ram and/or a battery
         bool has_ram; bool has_battery;
         
-        // Path to file where non-volatile memory is stored
+        // Path to file where non-volatile memory is stored - if empty, the memory is not stored
         std::string memory_path;
         
     public:
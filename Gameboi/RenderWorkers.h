@@ -0,0 +1,102 @@
+// Created by Niklas on 19/10/2026.
+// Class which keeps a set of worker threads waiting for a job, so each frame can be drawn in parallel without starting
+// new threads - the ppu gives the workers one job per frame (see ppu_core::start_frame_render)
+// Each worker is told its index and the number of workers, and picks its own share of the job
+
+#ifndef RenderWorkers_h
+#define RenderWorkers_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace gb {
+    class render_workers {
+    public:
+        // Destructor waits for the current job and stops the workers
+        ~render_workers(){
+            stop();
+        }
+        
+        // Function to start job(worker index, number of workers) on every worker, after the last job has finished
+        // The workers are started the first time, and started again if the number of workers changes
+        void start(int num_workers, std::function<void(int, int)> _job){
+            wait();
+            if (num_workers != (int)workers.size()) {
+                stop();
+                for (int i = 0; i < num_workers; i++)
+                    workers.emplace_back(&render_workers::run_worker, this, i, generation);
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(job_mutex);
+                job = std::move(_job);
+                jobs_left = num_workers;
+                generation++;
+            }
+            job_changed.notify_all();
+        }
+        
+        // Function to wait for every worker to finish the current job - returns straight away if there is none
+        void wait(){
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_done.wait(lock, [this]{ return jobs_left == 0; });
+        }
+    
+    private:
+        // Stores the workers, and the job they run
+        std::vector<std::thread> workers;
+        std::function<void(int, int)> job;
+        
+        // Stores the workers still running the current job, the number of jobs started so far (workers wait for it
+        // to change), and whether the workers should exit
+        int jobs_left = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+        
+        std::mutex job_mutex;
+        std::condition_variable job_changed;
+        std::condition_variable job_done;
+        
+        // Function to wait for the current job and stop the workers
+        void stop(){
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(job_mutex);
+                stopping = true;
+            }
+            job_changed.notify_all();
+            
+            for (std::thread& worker: workers)
+                worker.join();
+            workers.clear();
+            stopping = false;
+        }
+        
+        // Function which runs on each worker, running every job started after the worker was
+        void run_worker(int index, uint64_t last_generation){
+            std::unique_lock<std::mutex> lock(job_mutex);
+            
+            while (true) {
+                job_changed.wait(lock, [&]{ return stopping or generation != last_generation; });
+                if (stopping)
+                    return;
+                
+                // Runs the job without holding the lock, so the other workers can run it at the same time
+                last_generation = generation;
+                int num_workers = (int)workers.size();
+                lock.unlock();
+                job(index, num_workers);
+                lock.lock();
+                
+                if (--jobs_left == 0)
+                    job_done.notify_all();
+            }
+        }
+    };
+}
+
+#endif /* RenderWorkers_h */
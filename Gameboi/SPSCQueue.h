@@ -0,0 +1,80 @@
+// Created by Niklas on 19/10/2026.
+// Lock-free queue with a single producer thread and a single consumer thread
+// Used to send inputs from the frontend to the emulation thread, and samples from the apu to the audio callback
+
+#ifndef SPSCQueue_h
+#define SPSCQueue_h
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+namespace gb {
+    // Capacity must be a power of 2
+    template <typename T, size_t capacity>
+    class spsc_queue {
+        static_assert((capacity & (capacity - 1)) == 0, "spsc_queue capacity must be a power of 2");
+    
+    public:
+        // Function for the producer to add an item - returns false if the queue is full
+        bool push(const T& item){
+            size_t head = write_count.load(std::memory_order_relaxed);
+            if (head - read_count.load(std::memory_order_acquire) == capacity)
+                return false;
+            
+            buffer[head & (capacity - 1)] = item;
+            write_count.store(head + 1, std::memory_order_release);
+            return true;
+        }
+        
+        // Function for the consumer to remove the oldest item - returns false if the queue is empty
+        bool pop(T& item){
+            size_t tail = read_count.load(std::memory_order_relaxed);
+            if (tail == write_count.load(std::memory_order_acquire))
+                return false;
+            
+            item = buffer[tail & (capacity - 1)];
+            read_count.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        
+        // Function for the producer to add up to count items at once - returns the number added, which is fewer
+        // than count if the queue fills up
+        size_t push(const T* items, size_t count){
+            size_t head = write_count.load(std::memory_order_relaxed);
+            count = std::min(count, capacity - (head - read_count.load(std::memory_order_acquire)));
+            
+            for (size_t i = 0; i < count; i++)
+                buffer[(head + i) & (capacity - 1)] = items[i];
+            write_count.store(head + count, std::memory_order_release);
+            return count;
+        }
+        
+        // Function for the consumer to remove up to count of the oldest items at once - returns the number removed
+        size_t pop(T* items, size_t count){
+            size_t tail = read_count.load(std::memory_order_relaxed);
+            count = std::min(count, write_count.load(std::memory_order_acquire) - tail);
+            
+            for (size_t i = 0; i < count; i++)
+                items[i] = buffer[(tail + i) & (capacity - 1)];
+            read_count.store(tail + count, std::memory_order_release);
+            return count;
+        }
+        
+        // Function to get the number of items in the queue (only exact when called from the producer or consumer)
+        size_t size() const {
+            return write_count.load(std::memory_order_acquire) - read_count.load(std::memory_order_acquire);
+        }
+    
+    private:
+        // Counts of items ever written and read - the counters are on separate cache lines so the two threads
+        // do not fight over them, and they only ever increase so a full queue is told apart from an empty one
+        alignas(64) std::atomic<size_t> write_count{0};
+        alignas(64) std::atomic<size_t> read_count{0};
+        
+        // Stores the items
+        alignas(64) T buffer[capacity];
+    };
+}
+
+#endif /* SPSCQueue_h */
@@ -0,0 +1,70 @@
+// Created by Niklas on 19/10/2026.
+// Interfaces between the emulator core and a frontend - the core has no dependency on any windowing or audio library
+// A frontend passes its own implementations to the EmulationController and the apu
+
+#ifndef Sinks_h
+#define Sinks_h
+
+#include <cstdint>
+#include <cstddef>
+
+#include "ppu.h"
+
+namespace gb {
+    // Receives each frame drawn by the ppu, straight after the frame is emulated (see EmulationController::emulate_frame)
+    class video_sink {
+    public:
+        virtual ~video_sink(){}
+        
+        // Function called with each newly drawn frame - the frame may be reused once this returns
+        virtual void present_frame(const gb::frame& frame) = 0;
+    };
+    
+    // Video sink which only hashes each frame it is given, for runs without a window (eg the headless runner and the
+    // benchmarks, where changes in emulation behaviour show up as a different hash)
+    class hashing_video_sink : public video_sink {
+    public:
+        // Stores the number of frames presented and the hash of the last one
+        long frames = 0;
+        uint64_t last_hash = 0;
+        
+        virtual void present_frame(const gb::frame& frame){
+            last_hash = gb::hash_frame(frame);
+            frames++;
+        }
+    };
+    
+    // Plays the apu's output - one stream of 16 bit stereo samples, mixed in emulated time
+    class audio_sink {
+    public:
+        virtual ~audio_sink(){}
+        
+        // Function called when the apu is initialised, with the sample rate it will make samples at
+        virtual void start(int sample_rate) = 0;
+        
+        // Function called with each block of samples, interleaved left then right - count is the number of stereo samples
+        // Called from the emulation thread, and the samples may be reused once this returns
+        virtual void push_samples(const int16_t* samples, size_t count) = 0;
+        
+        // Function called to stop all sound
+        virtual void stop() = 0;
+        
+        // Function to get how full the queue of samples waiting to be played is, from 0 to 1 - the apu adjusts its
+        // sample rate slightly to keep it half full, and the emulation can be paced by it (see EmulationController.h)
+        // Returns -1 for sinks without a queue, eg ones which write to a file
+        virtual double fill_level(){
+            return -1;
+        }
+    };
+    
+    // Supplies the states of the buttons before each frame is emulated
+    class input_source {
+    public:
+        virtual ~input_source(){}
+        
+        // Function to get the button states (bit 0 - 7 = a, b, up, down, left, right, start, select, 1 = pressed)
+        virtual uint8_t get_key_states() = 0;
+    };
+}
+
+#endif /* Sinks_h */
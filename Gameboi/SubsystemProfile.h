@@ -0,0 +1,100 @@
+// Created by Niklas on 19/10/2026.
+// Struct which measures how the emulation time is shared between the cpu, the ppu, the bus and the apu
+// Only every sample_interval'th instruction is timed, but reading the clock still slows the emulation down a little, so
+// throughput should be measured in a separate run without a profile (see emulation_benchmark)
+// Bus time is the bus's own cycles (timers, serial) plus every read and write made through it, which the bus times
+// itself while profiling - they are taken out of the time of the cpu, ppu or apu which made them
+
+#ifndef SubsystemProfile_h
+#define SubsystemProfile_h
+
+#include <chrono>
+
+namespace gb {
+    struct subsystem_profile {
+        // Subsystem numbers used to index the measurements
+        // A single ppu cycle or bus access is quicker than reading the clock, so the cost of reading the clock is
+        // measured and taken out of every measurement
+        enum {CPU = 0, PPU = 1, BUS = 2, APU = 3};
+        static const int num_subsystems = 4;
+        
+        typedef std::chrono::steady_clock clock;
+        
+        // Times one in this many instructions
+        int sample_interval = 64;
+        
+        // Stores the measured time of each subsystem in ns, and the number of instructions timed
+        double ns[num_subsystems] = {0, 0, 0, 0};
+        long long samples = 0;
+        
+        subsystem_profile(){
+            calibrate();
+        }
+        
+        // Function called before each instruction - returns true if this instruction should be timed
+        bool sample(){
+            if (++counter < sample_interval)
+                return false;
+            
+            counter = 0;
+            samples++;
+            return true;
+        }
+        
+        // Function to add the time between two clock readings to a subsystem, minus the cost of reading the clock and
+        // the time of any measurements nested inside
+        void add(int subsystem, clock::time_point start, clock::time_point end){
+            ns[subsystem] += std::chrono::duration<double, std::nano>(end - start).count() - clock_overhead_ns - nested_ns;
+            nested_ns = 0;
+        }
+        
+        // Function to add a measurement made inside another (eg a bus read made by the cpu), which is taken out of the
+        // outer measurement along with the two clock readings it took
+        void add_nested(int subsystem, clock::time_point start, clock::time_point end){
+            double measured_ns = std::chrono::duration<double, std::nano>(end - start).count();
+            ns[subsystem] += measured_ns - clock_overhead_ns;
+            nested_ns += measured_ns + clock_overhead_ns;
+        }
+        
+        // Function to get the share of the measured time a subsystem took (0 - 1)
+        double share(int subsystem) const {
+            double total = 0;
+            for (int i = 0; i < num_subsystems; i++)
+                total += ns[i] > 0 ? ns[i] : 0;
+            
+            return total > 0 and ns[subsystem] > 0 ? ns[subsystem] / total : 0;
+        }
+        
+        // Function to clear all measurements
+        void reset(){
+            for (int i = 0; i < num_subsystems; i++)
+                ns[i] = 0;
+            
+            samples = 0;
+            counter = 0;
+            nested_ns = 0;
+        }
+    
+    private:
+        // Counts instructions since the last timed one
+        int counter = 0;
+        
+        // Stores the time of the nested measurements made since the last outer one, including their clock readings
+        double nested_ns = 0;
+        
+        // Stores the average time between two back to back clock readings, which is included in every measurement
+        double clock_overhead_ns = 0;
+        
+        // Function to measure the clock overhead
+        void calibrate(){
+            const int readings = 10000;
+            clock::time_point start = clock::now();
+            for (int i = 0; i < readings - 1; i++)
+                clock::now();
+            
+            clock_overhead_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / readings;
+        }
+    };
+}
+
+#endif /* SubsystemProfile_h */
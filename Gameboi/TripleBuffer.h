@@ -0,0 +1,60 @@
+// Created by Niklas on 19/10/2026.
+// Lock-free triple buffer for handing complete frames from the emulation to the presentation
+// One thread writes into the back buffer and publishes it, another reads the newest published buffer
+
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <atomic>
+#include <cstdint>
+
+namespace gb {
+    template <typename T>
+    class triple_buffer {
+    public:
+        // Function for the writer to get the buffer it is currently filling
+        T& back(){
+            return buffers[back_index];
+        }
+
+        // Function for the writer to publish a complete back buffer - it is swapped with the middle buffer
+        // and marked as fresh, and the writer carries on in the old middle buffer
+        void publish(){
+            back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // Function for the reader to fetch the newest published buffer - returns false if nothing new was published
+        bool update(){
+            if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        // Function for the reader to get the last buffer it fetched - never written to until the next update
+        const T& front() const {
+            return buffers[front_index];
+        }
+
+        // Function to access all three buffers, eg to reset them - only safe when no other thread is using them
+        T& operator[](int index){
+            return buffers[index];
+        }
+
+    private:
+        // Bit in the middle index marking that it holds a buffer the reader has not fetched yet
+        static const uint8_t FRESH = 0b100;
+        static const uint8_t INDEX_MASK = 0b011;
+
+        // Stores the three buffers
+        T buffers[3];
+
+        // Index of the buffer owned by each side - the middle index is shared, so it is atomic
+        uint8_t back_index = 0;
+        std::atomic<uint8_t> middle{1};
+        uint8_t front_index = 2;
+    };
+}
+
+#endif /* TripleBuffer_h */
@@ -13,6 +13,7 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "apu.h"
+#include "DirtyRows.h"
 
 class ViewController {
 private:
@@ -22,6 +23,11 @@ private:
     // Stores the ppu which creates frame data
     gb::ppu* ppu;
     
+    // Stores a 160 x 144 texture which holds the gameboy screen, and a sprite to draw it scaled up
+    sf::Texture screen_texture;
+    sf::Sprite screen_sprite;
+    int screen_scale;
+    
     // Stores the pallette to convert gameboy color values into actual colors
     // 3 is darkest, 0 is lightest
     // Greyscale pallette:
@@ -32,17 +38,34 @@ private:
     sf::Color master_pallette[4] = {sf::Color(217, 252, 205), sf::Color(117, 198, 104), sf::Color(30, 107, 86),  sf::Color(4, 24, 33)};
 
 public:
-    // Constructor binds a window and a ppu
-    ViewController(sf::RenderWindow* _window, gb::ppu* _ppu){
+    // Tracks which rows of the screen texture are out of date, so only changed rows are uploaded
+    gb::dirty_rows screen_rows;
+    
+    // Constructor binds a window and a ppu, and takes the scale the screen is drawn at
+    ViewController(sf::RenderWindow* _window, gb::ppu* _ppu, int _screen_scale){
         window = _window;
         ppu = _ppu;
+        screen_scale = _screen_scale;
+        
+        // Passes the pallette to the ppu, so it can resolve RGBA colours itself
+        for (int i = 0; i < 4; i++)
+            ppu->set_host_pallette(i, master_pallette[i].r, master_pallette[i].g, master_pallette[i].b);
+        ppu->output_rgba = true;
+        
+        // Creates the screen texture and a sprite which scales it up
+        screen_texture.create(160, 144);
+        screen_sprite.setTexture(screen_texture);
+        screen_sprite.setScale(screen_scale, screen_scale);
+        
+        // Rows a few apart are uploaded together, as each upload has its own overhead
+        screen_rows.merge_gap = 4;
     }
     
     // Function to draw a frame in cinematic mode
-    void draw_cinematic_frame(sf::View& cinematic_view, sf::VertexArray& screen, gb::bus& bus){
+    void draw_cinematic_frame(sf::View& cinematic_view, bool LCD_enabled){
         window->setSize(sf::Vector2u(960, 864));
         window->setView(cinematic_view);
-        draw_screen(screen, bus);
+        draw_screen(LCD_enabled);
     }
     
     
@@ -175,30 +198,39 @@ public:
         }
     }
     
-    // Draws the actual gameboy screen
-    void draw_screen(sf::VertexArray& screen_verts, gb::bus& bus){
-        // Gets whether LCD is enabled from LCDC bit 7
-        bool LCD_enabled = gb::Utils::get_bit(bus.read(0xFF40), 7);
-        
-        for (int x = 0; x < 160; x++){
-            for(int y = 0; y < 144; y++){
-                int index = 4 * (y * 160 + x);
-                // If screen is disabled, draw all zeroes
-                sf::Color color = LCD_enabled ? master_pallette[ppu->frame_buffer[y][x]] : master_pallette[0];
+    // Draws the actual gameboy screen - the newest complete frame, or if live is true, the frame the ppu is
+    // currently drawing (live must only be used while holding the emulation's state mutex)
+    // When the ppu renders in parallel, the frame being drawn belongs to its workers, so live is ignored
+    void draw_screen(bool LCD_enabled, bool live = false){
+        if (LCD_enabled) {
+            if (live and !ppu->parallel_rendering) {
+                // Uploads the frame which is being drawn, so single steps can be seen - the texture then no longer
+                // matches the last complete frame, so the next one is uploaded in full
+                screen_texture.update(reinterpret_cast<const sf::Uint8*>(ppu->frames.back().rgba));
+                screen_rows.invalidate();
                 
-                //sf::Color color = sf::Color::Green;
-                screen_verts[index + 0].color = color;
-                screen_verts[index + 1].color = color;
-                screen_verts[index + 2].color = color;
-                screen_verts[index + 3].color = color;
+            } else if (ppu->frames.update()) {
+                // Fetches the newest complete frame from the ppu, and only uploads the rows which have changed
+                const gb::frame& frame = ppu->frames.front();
+                for (gb::row_range rows: screen_rows.update(frame)){
+                    screen_texture.update(reinterpret_cast<const sf::Uint8*>(&frame.rgba[160 * rows.first]),
+                                          160, rows.last - rows.first, 0, rows.first);
+                }
             }
+            
+            // Draws the whole screen as a single sprite
+            draw(screen_sprite);
+        } else {
+            // If screen is disabled, draw all zeroes
+            draw_rect(master_pallette[0], 160 * screen_scale, 144 * screen_scale, 0, 0);
         }
-        draw(screen_verts);
-        
-        // Draws a red screen to show the current scanline
+    }
+    
+    // Draws a red square next to the screen to show the current scanline
+    void draw_scanline_indicator(){
         sf::RectangleShape scanline_indicator;
-        scanline_indicator.setPosition(640, ppu->num_scanlines * 4);
-        scanline_indicator.setSize(sf::Vector2f(4, 4));
+        scanline_indicator.setPosition(160 * screen_scale, ppu->num_scanlines * screen_scale);
+        scanline_indicator.setSize(sf::Vector2f(screen_scale, screen_scale));
         scanline_indicator.setFillColor(sf::Color::Red);
         draw(scanline_indicator);
     }
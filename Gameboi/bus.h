@@ -9,15 +9,26 @@
 #include "VRAM.h"
 #include "IO_Regs.h"
 #include "OAM.h"
+#include "Serial.h"
 
 #include "MBC_Base.h"
 #include "ROM_Only.h"
 #include "MBC1.h"
 #include "MBC3.h"
 
+#include "SubsystemProfile.h"
+
 #include <iostream>
+#include <vector>
 
 namespace gb{
+    // A write to an APU register (FF10 - FF3F), with the master clock it was made at and the value the register holds
+    struct apu_write {
+        uint64_t clock;
+        uint8_t reg;
+        uint8_t value;
+    };
+    
     class bus {
     private:
         // Handles cpu reading and writing to devices
@@ -57,13 +68,14 @@ namespace gb{
         
         // Creates objects to store the devices
         gb::cartridge_rom* cart_rom = new gb::cartridge_rom(); // Cartridge ROM
-        gb::MBC_Base* mapper; // Mapper from 0x0000 - 0x7FFF and 0xA000 - 0xBFFF
+        gb::MBC_Base* mapper = nullptr; // Mapper from 0x0000 - 0x7FFF and 0xA000 - 0xBFFF
 
         gb::vram* v_ram = new gb::vram(); // VRAM from 8000 - 9FFF
         gb::ram* work_ram = new gb::ram(0xC000, 0xDFFF); // WRAM from C000 - DFFF
         gb::ram* h_ram = new gb::ram(0xFF00, 0xFFFE); // HRAM from FF00 - FFFE
         gb::oam* oam = new gb::oam(); // OAM from FE00 - FE9F
         gb::io_regs* io_ports = new gb::io_regs(); // IO Ports from FF00 - FF4B
+        gb::serial_port* serial = new gb::serial_port(); // Serial transfers started through SC (FF02)
         
         uint8_t IE = 0; // Interrupt enable register at FFFF
         
@@ -90,17 +102,40 @@ namespace gb{
         // Stores whether the bios is enabled
         bool bios_enabled = true;
         
-        // Flags which signal that the APU needs to update audio settings
-        bool update_apu = true;
-        bool update_square1_envelope = false;
-        bool update_square2_envelope = false;
-        bool update_noise_envelope = false;
+        // Counts the clocks run since power on - the master clock which APU writes are timestamped with
+        uint64_t clock = 0;
+        
+        // Log of the APU register writes made since the APU last handled them, in the order they were made
+        std::vector<gb::apu_write> apu_write_log;
+
+        // Flag which signals that the PPU needs to decode the LCD registers again
+        bool update_lcd_registers = true;
+        
+        // Flags which signal that VRAM or OAM have been written since the PPU last copied them
+        bool vram_written = true;
+        bool oam_written = true;
+        
+        // Counts every read and write made through the bus, for reporting how many are made per frame
+        unsigned long long read_count = 0;
+        unsigned long long write_count = 0;
+        
+        // Optional profile - while it is set, every read and write is timed as bus time (see EmulationController)
+        gb::subsystem_profile* profile = nullptr;
         
         // Function to do one cycle, used for incrementing timers
         void do_cycle() {
+            clock += 4;
             cycles_since_div_increment += 4;
             cycles_since_timer_increment += 4;
             
+            // When a serial transfer completes, SB holds the received byte (always FF), SC bit 7 is cleared and
+            // a serial interrupt is triggered
+            if (serial->do_cycle()) {
+                set_ioreg(gb::regNames::SB, 0xFF);
+                set_ioreg(gb::regNames::SC, get_ioreg(gb::regNames::SC) & 0b01111111);
+                write(0xFF0F, read(0xFF0F) | 0b00001000);
+            }
+            
             // If more than 256 cycles have elapsed since DIV was incrmented, increment DIV and reset count
             if (cycles_since_div_increment >= 256) {
                 io_ports->increment_div();
@@ -197,10 +232,40 @@ namespace gb{
             io_ports->store_key_states(_a, _b, _up, _down, _left, _right, _start, _select);
         }
         
-        // Function to write to any memory address
+        // Function to write to any memory address, counting the write and timing it while profiling
         void write(uint16_t addr, uint8_t data){
-            //if (addr == 0xFF01)
-                //std::cout << (char)data;
+            write_count++;
+            if (!profile) {
+                write_memory(addr, data);
+                return;
+            }
+            
+            // Accesses made by this one (eg by OAM DMA) are timed as part of it
+            gb::subsystem_profile* timing_profile = profile;
+            profile = nullptr;
+            gb::subsystem_profile::clock::time_point start = gb::subsystem_profile::clock::now();
+            write_memory(addr, data);
+            timing_profile->add_nested(gb::subsystem_profile::BUS, start, gb::subsystem_profile::clock::now());
+            profile = timing_profile;
+        }
+        
+        // Function to read from any memory address, counting the read and timing it while profiling
+        uint8_t read(uint16_t addr){
+            read_count++;
+            if (!profile)
+                return read_memory(addr);
+            
+            gb::subsystem_profile* timing_profile = profile;
+            profile = nullptr;
+            gb::subsystem_profile::clock::time_point start = gb::subsystem_profile::clock::now();
+            uint8_t data = read_memory(addr);
+            timing_profile->add_nested(gb::subsystem_profile::BUS, start, gb::subsystem_profile::clock::now());
+            profile = timing_profile;
+            return data;
+        }
+        
+        // Function to write to any memory address without counting or timing the write
+        void write_memory(uint16_t addr, uint8_t data){
             // If 01 is written to FF50, disable the bios
             if (addr == 0xFF50 and data == 0x01)
                 bios_enabled = false;
@@ -214,6 +279,7 @@ namespace gb{
                 case 0x8000: case 0x9000:
                     // VRAM from 8000 - 9FFF
                     v_ram->write(addr, data);
+                    vram_written = true;
                     break;
                 case 0xA000: case 0xB000:
                     // Mapper ram area from A000 - BFFF
@@ -236,8 +302,10 @@ namespace gb{
                             break;
                         case 0xE00:
                             // OAM / empty space from FE00 - FEFF
-                            if (addr < 0xFEA0)
+                            if (addr < 0xFEA0) {
                                 oam->write(addr, data);
+                                oam_written = true;
+                            }
                             break;
                         case 0xF00:
                             // IO registers, hram and interrupt enable register FF00 - FFFF
@@ -261,17 +329,23 @@ namespace gb{
                 do_OAM_DMA();
             }
             
-            // If address is between FF10 and FF3F, sets the flag for the APU to update
-            if (addr >= 0xFF10 and addr < 0xFF40) update_apu = true;
-            
-            // If address is FF12, sets the flag for the APU to update square wave 1 envelope
-            if (addr == 0xFF12) update_square1_envelope = true;
+            // If address is FF02, starts a serial transfer
+            if (addr == 0xFF02) serial->write_control(data, get_ioreg(gb::regNames::SB));
             
-            // If address is FF17, sets the flag for the APU to update square wave 2 envelope
-            if (addr == 0xFF17) update_square2_envelope = true;
-            
-            // If address is FF42, sets the flag for the APU to update noise envelope
-            if (addr == 0xFF42) update_noise_envelope = true;
+            // If address is between FF10 and FF3F, logs the write for the APU to handle at the clock it was made
+            if (addr >= 0xFF10 and addr < 0xFF40) apu_write_log.push_back({clock, (uint8_t)addr, get_ioreg((uint8_t)addr)});
+
+            // If address is between FF40 and FF4B (LCD registers) but not LY, sets the flag for the PPU to decode them
+            if (addr >= 0xFF40 and addr <= 0xFF4B and addr != 0xFF44) update_lcd_registers = true;
+        }
+        
+        // Function to get every byte sent through the serial port, and to choose whether they are printed too
+        const std::string& get_serial_output(){
+            return serial->output;
+        }
+        
+        void echo_serial_output(bool echo){
+            serial->echo = echo;
         }
         
         // Function to get an io register - faster than reading
@@ -279,8 +353,22 @@ namespace gb{
             return io_ports->get(reg_num);
         }
         
-        // Function to read from any memory address
-        uint8_t read(uint16_t addr){
+        // Functions to get the contents of VRAM (8000 - 9FFF) and OAM (FE00 - FE9F) as arrays, for the ppu to draw from
+        const uint8_t* get_vram(){
+            return v_ram->get_data();
+        }
+        
+        const uint8_t* get_oam(){
+            return oam->get_data();
+        }
+        
+        // Function to set an io register without any side effects - used by devices updating their own status registers
+        void set_ioreg(uint8_t reg_num, uint8_t data){
+            io_ports->set(reg_num, data);
+        }
+        
+        // Function to read from any memory address without counting or timing the read
+        uint8_t read_memory(uint16_t addr){
             // If bios is enabled and address is less than 0100 the read from bios
             if (addr < 0x0100 and bios_enabled)
                 return bios[addr];
@@ -330,6 +418,9 @@ namespace gb{
         
         // Constructor
         bus(){
+            // Makes room for more APU writes than a frame of music makes, so logging them never allocates
+            apu_write_log.reserve(4096);
+            
             // Writes 91 to LCDC at startup
             write(0xFF40, 0x91);
         }
@@ -343,6 +434,7 @@ namespace gb{
             delete h_ram;
             delete oam;
             delete io_ports;
+            delete serial;
         }
     };
 }
@@ -5,10 +5,12 @@
 #include <SFML/Graphics.hpp>
 #include <string.h>
 #include <iostream>
+#include <mutex>
 
 // Custom includes
 #include "ViewController.h"
 #include "EmulationController.h"
+#include "AudioController.h"
 
 #define SCREEN_SCALE 4
 
@@ -31,14 +33,15 @@ int main(int, const char **) {
     const Keyboard::Key start_key = Keyboard::Key::Enter;
     const Keyboard::Key select_key = Keyboard::Key::Tab;
     
+    // Holding this key fast forwards, emulating as fast as possible and skipping the drawing of frames
+    const Keyboard::Key fast_forward_key = Keyboard::Key::LShift;
+    
     // Array to store all key values for quick looping
     const Keyboard::Key all_keys[8] = {a_key, b_key, up_key, down_key, left_key, right_key, start_key, select_key};
     
-    // Keeps track of whether the cpu is executing
-    bool executing = true;
-    bool do_once = false;
-    bool do_one_scanline = false;
-    bool do_one_frame = false;
+    // Stores the last key states and fast forward state sent to the emulation thread
+    uint8_t sent_key_states = 0;
+    bool sent_fast_forward = false;
     
     RenderWindow window(VideoMode(1360, 850), "SFML window", Style::Close);
     //window.setFramerateLimit(60);
@@ -47,6 +50,13 @@ int main(int, const char **) {
     // Keeps track of whether emulator is in cinematic mode
     bool cinematic_mode = true;
     
+    // Measures the time spent drawing each frame and the time between displayed frames, averaged over 60 frames
+    // and printed when show_timing is on (the emulation thread prints its own frame timing)
+    bool show_timing = false;
+    Clock draw_clock;
+    float draw_time_total = 0;
+    gb::frame_timing render_timing;
+    
     // Creates a view for cinematic mode
     View cinematic_view(Vector2f(318, 286), Vector2f(641, 577));
     cinematic_view.setViewport(FloatRect(0, 0, 1, 1));
@@ -61,11 +71,22 @@ int main(int, const char **) {
     gb::cpu cpu; gb::ppu ppu; gb::bus bus; gb::apu apu;
     EmulationController emulator(&cpu, &bus, &ppu, &apu, romspath, savespath);
     
+    // Plays the apu's channels through SFML, and keeps the emulation speed by the audio clock
+    AudioController audio;
+    apu.connect_audio(&audio);
+    emulator.audio_sync = true;
+    
     emulator.init(filepath + "bios.bin");
     emulator.load_rom("tetris");
+    
+    // Skip drawing frames if the host cannot keep up with the gameboy
+    emulator.adaptive_frame_skip = true;
+    
+    // Draws frames on worker threads if the host has cores to spare
+    ppu.parallel_rendering = std::thread::hardware_concurrency() > 2;
 
     // Initialise the main view controller with a reference to the window
-    ViewController view(&window, &ppu);
+    ViewController view(&window, &ppu, SCREEN_SCALE);
     
     // Creates a vertex array for visualising memory contents
     float visualiser_x = 1000;
@@ -78,18 +99,6 @@ int main(int, const char **) {
         }
     }
     
-    // Creates a vertex array for drawing the actual screen
-    VertexArray screen(Quads, 4 * 160 * 144);
-    for (int x = 0; x < 160; x++){
-        for (int y = 0; y < 144; y++){
-            int index = 4 * (y * 160 + x);
-            screen[index + 0].position = Vector2f(SCREEN_SCALE * x, SCREEN_SCALE * (y + 1));
-            screen[index + 1].position = Vector2f(SCREEN_SCALE * x, SCREEN_SCALE * y);
-            screen[index + 2].position = Vector2f(SCREEN_SCALE * (x + 1), SCREEN_SCALE * y);
-            screen[index + 3].position = Vector2f(SCREEN_SCALE * (x + 1), SCREEN_SCALE * (y + 1));
-        }
-    }
-
     // Set the Icon
     Image icon;
     if (!icon.loadFromFile(filepath + "icon.png")) {
@@ -104,6 +113,9 @@ int main(int, const char **) {
         return EXIT_FAILURE;
     }
     
+    // Starts emulating on its own thread - this thread only handles events and presents frames
+    emulator.start_thread();
+    
     // Main Game Loop
     while (window.isOpen())
     {
@@ -115,12 +127,13 @@ int main(int, const char **) {
             if (event.type == Event::KeyPressed){
                 for (Keyboard::Key i: all_keys){
                     if (event.key.code == i)
-                        cpu.stopped = false;
+                        emulator.inputs.push({InputEvent::KEY_PRESSED});
                 }
             }
             
-            // Close window: save battery-backed ram and exit
+            // Close window: stop emulating, save battery-backed ram and exit
             if (event.type == Event::Closed) {
+                emulator.stop_thread();
                 apu.stop_all();
                 bus.close();
                 window.close();
@@ -128,65 +141,68 @@ int main(int, const char **) {
             
             // Space pressed: toggle cpu executing
             if (event.type == Event::KeyPressed && event.key.code == Keyboard::Space){
-                executing = !executing;
+                emulator.inputs.push({InputEvent::TOGGLE_EXECUTING});
             }
             
-            // Enter: set do_once to true
+            // I: emulate one instruction
             if (event.type == Event::KeyPressed && event.key.code == Keyboard::I){
-                do_once = true;
+                emulator.inputs.push({InputEvent::STEP_INSTRUCTION});
             }
             
-            // S: set do_one scanline to true
+            // S: emulate one scanline
             if (event.type == Event::KeyPressed && event.key.code == Keyboard::S){
-                do_one_scanline = true;
+                emulator.inputs.push({InputEvent::STEP_SCANLINE});
             }
             
-            // F: set do_one_frame to true
+            // F: emulate one frame
             if (event.type == Event::KeyPressed && event.key.code == Keyboard::F){
-                do_one_frame = true;
+                emulator.inputs.push({InputEvent::STEP_FRAME});
             }
             
             // C: toggle cinematic mode
             if (event.type == Event::KeyPressed && event.key.code == Keyboard::C){
                 cinematic_mode = !cinematic_mode;
+                draw_time_total = 0;
+                render_timing.reset();
+            }
+            
+            // T: toggle printing frame timing
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::T){
+                show_timing = !show_timing;
+                emulator.inputs.push({InputEvent::REPORT_TIMING, show_timing});
             }
         }
-        // Sends the states of pressed keys to the bus
-        bus.store_key_states(Keyboard::isKeyPressed(a_key), Keyboard::isKeyPressed(b_key),
-                             Keyboard::isKeyPressed(up_key), Keyboard::isKeyPressed(down_key),
-                             Keyboard::isKeyPressed(left_key), Keyboard::isKeyPressed(right_key),
-                             Keyboard::isKeyPressed(start_key), Keyboard::isKeyPressed(select_key));
         
-        // Processing -------------------------------------------------------------------
-        if (executing or do_one_frame) {
-            // Emulate one frame
-            if (emulator.emulate_frame())
-                executing = false;
-            
-            do_one_frame = false;
-            
-        } else if (do_one_scanline){
-            // Emulate one scanline
-            emulator.emulate_scanline();
-            do_one_scanline = false;
-            
-        } else if (do_once){
-            // Emulate one instruction
-            emulator.emulate_instruction();
-            do_once = false;
-        }
+        if (!window.isOpen())
+            break;
+        
+        // Sends the states of pressed keys to the emulation thread if they have changed
+        uint8_t key_states = 0;
+        for (int i = 0; i < 8; i++)
+            key_states |= Keyboard::isKeyPressed(all_keys[i]) << i;
+        
+        if (key_states != sent_key_states and emulator.inputs.push({InputEvent::KEY_STATES, key_states}))
+            sent_key_states = key_states;
+        
+        bool fast_forward = Keyboard::isKeyPressed(fast_forward_key);
+        if (fast_forward != sent_fast_forward and emulator.inputs.push({InputEvent::FAST_FORWARD, fast_forward}))
+            sent_fast_forward = fast_forward;
         
         // Drawing ----------------------------------------------------------------------
+        draw_clock.restart();
         window.clear(bg_color);
         
         // If in cinematic mode, set window size to 960 * 864 and only draw screen
         if (cinematic_mode){
-            view.draw_cinematic_frame(cinematic_view, screen, bus);
+            view.draw_cinematic_frame(cinematic_view, emulator.lcd_enabled);
         } else {
             // Otherwise, set window size to 1360 * 850 and draw all debug info
             window.setSize(Vector2u(1360, 850));
             window.setView(default_view);
             
+            // Debug info reads the emulator's state, so emulation waits until it has been drawn
+            std::lock_guard<std::mutex> lock(emulator.state_mutex);
+            
             view.draw_text("Inputs", Color::Red, font, 30, 650, 500);
             view.draw_inputs(Keyboard::isKeyPressed(a_key), Keyboard::isKeyPressed(b_key),
                              Keyboard::isKeyPressed(up_key), Keyboard::isKeyPressed(down_key),
@@ -212,8 +228,23 @@ int main(int, const char **) {
             view.draw_text("APU Status", Color::Red, font, 30, 10, 580);
             view.draw_apu_state(bus, apu, font, 10, 620);
             
-            view.draw_screen(screen, bus);
+            view.draw_screen(emulator.lcd_enabled, true);
+            view.draw_scanline_indicator();
         }
+        
+        // Averages the draw time and the time between displayed frames over 60 frames
+        draw_time_total += draw_clock.getElapsedTime().asSeconds() * 1000.0;
+        render_timing.tick();
+        if (render_timing.frames() >= 60) {
+            if (show_timing)
+                std::cout << (cinematic_mode ? "Cinematic" : "Debug") << " draw time: " << draw_time_total / render_timing.frames()
+                          << " ms, render frame time: " << render_timing.summary()
+                          << ", screen rows changed: " << 100 * view.screen_rows.dirty_fraction() << "%" << std::endl;
+            draw_time_total = 0;
+            render_timing.reset();
+            view.screen_rows.reset_stats();
+        }
+        
         // End of Frame Code ------------------------------------------------------------
         window.display();
     }
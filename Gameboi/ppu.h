@@ -1,6 +1,7 @@
 // Created by Niklas on 31/03/2020.
 // Creates a class for the ppu which lodas the graphics data from memory
-// This class handles the graphcis data - the actual drawing is done by the ViewController Class
+// This class draws each frame itself - it resolves the palettes and writes the shades and RGBA pixels of the frame, and
+// the ViewController Class only uploads the finished frame to its texture
 
 #ifndef ppu_h
 #define ppu_h
@@ -8,13 +9,97 @@
 #include <array>
 #include <vector>
 #include <tuple>
+#include <cstring>
+#include <algorithm>
+#include <thread>
 
 #include "Utils.h"
 #include "RegNames.h"
 #include "bus.h"
+#include "TripleBuffer.h"
+#include "RenderWorkers.h"
 
 namespace gb {
-    class ppu {
+    // Stores one complete frame drawn by the ppu
+    struct frame {
+        // Stores the shade (0 - 3) of each pixel
+        uint8_t shades[144][160];
+        
+        // Stores an RGBA32 copy, row major, with the bytes of each pixel in R, G, B, A order
+        // Colours are resolved through the host pallette, so presenting a frame is a straight copy
+        uint32_t rgba[144 * 160];
+        
+        // Stores a hash of each row of shades, so consumers can tell which rows changed between frames (see DirtyRows.h)
+        uint64_t row_hashes[144];
+    };
+    
+    // Function to hash one row of 160 shades (64 bit FNV-1a, over 8 pixels at a time)
+    inline uint64_t hash_row(const uint8_t* row){
+        uint64_t hash = 0xCBF29CE484222325;
+        for (int i = 0; i < 160; i += 8){
+            uint64_t pixels;
+            std::memcpy(&pixels, row + i, 8);
+            hash = (hash ^ pixels) * 0x100000001B3;
+        }
+        return hash;
+    }
+    
+    // Function to hash a whole frame from its row hashes, eg to compare frames between runs
+    inline uint64_t hash_frame(const gb::frame& frame){
+        uint64_t hash = 0;
+        for (int y = 0; y < 144; y++)
+            hash = hash * 31 + frame.row_hashes[y];
+        return hash;
+    }
+    
+    // Stores the LCD registers (FF40 - FF4B) decoded into plain values, so drawing does not read io registers
+    struct lcd_registers {
+        // LCDC (FF40) bits 7 - 0
+        bool lcd_enabled;
+        uint16_t window_map;        // 9800 or 9C00
+        bool window_enabled;
+        bool unsigned_tile_data;    // tiles are read from 8000 - 8FFF if true, or 8800 - 97FF if false
+        uint16_t background_map;    // 9800 or 9C00
+        int sprite_height;          // 8 or 16
+        bool sprites_enabled;
+        bool background_enabled;
+        
+        // STAT (FF41) bits 6 - 3, which enable the LCDC Status interrupt for each event
+        bool lyc_interrupt;
+        bool oam_interrupt;
+        bool vblank_interrupt;
+        bool hblank_interrupt;
+        
+        // Scroll position, LY compare, pallettes and window position
+        uint8_t scy, scx, lyc;
+        uint8_t bgp, obp0, obp1;
+        uint8_t wy, wx;
+        
+        // The window's own line counter, which only counts scanlines the window was drawn on - not a register, but
+        // stored with them so each scanline is drawn from its own copy
+        int window_line;
+    };
+    
+    // The default ppu backend, which draws each scanline all at once when h-blank starts
+    // Mode 3 always lasts 172 cycles, so the backend adds no work to each cycle
+    struct scanline_backend {
+        // Whether the ppu draws whole scanlines itself at the start of h-blank, rather than the backend drawing pixels
+        static const bool draws_whole_lines = true;
+        
+        // Function called every cycle from the end of mode 2 until it returns false - returns whether mode 3 is still going
+        template <typename ppu_type>
+        bool do_mode3(ppu_type& ppu){
+            return ppu.num_cycles < 252;
+        }
+    };
+    
+    // The ppu, with a backend which decides how long mode 3 lasts and how pixels are drawn (see scanline_backend)
+    // gb::ppu uses the scanline backend - FifoBackend.h has a slower, more accurate pixel FIFO backend
+    template <typename backend>
+    class ppu_core {
+        // The backend needs to read the ppu's registers, VRAM, OAM and frame buffers
+        friend backend;
+        
     public:
         // Stores the PPU's mode (0 - 3)
         // Mode 0 = h-blank, cpu can access VRAM and OAM
@@ -23,7 +108,8 @@ namespace gb {
         // Mode 3 = cpu cannot access VRAM or OAM
         int mode = 0;
         
-        // Stores how many cycles have elapsed on the current scaline and how many scanlines have elapsed on the current frame
+        // Stores how many cycles have elapsed on the current scaline and how many scanlines have elapsed on the current frame,
+        // and how many scanlines the window has been drawn on this frame
         int num_cycles = 0;
         int num_scanlines = 0;
         int window_scanlines = 0;
@@ -35,8 +121,27 @@ namespace gb {
         bool frame_over = false;
         bool scanline_over = false;
         
-        // Stores a frame buffer which is an array of ints, each representing the value of that pixel
-        uint8_t frame_buffer[144][160];
+        // Stores whether the current frame is drawn into the frame buffer
+        // Skipped frames keep exact mode, LY, STAT and interrupt timing - only draw_scanline is not called
+        bool render_frame = true;
+        
+        // Stores the frame buffers - the ppu draws into the back frame and publishes it when v-blank starts
+        // Presenters call frames.update() and read frames.front(), which is always a complete frame
+        gb::triple_buffer<gb::frame> frames;
+        
+        // Stores whether the ppu also draws the RGBA copy of each frame
+        bool output_rgba = false;
+        
+        // Stores whether frames are drawn in parallel - the emulation only records each scanline's LCD registers, VRAM
+        // and OAM, and render_threads workers draw the whole frame once v-blank is reached, while emulation carries on
+        // The workers are started with the first frame, and wait for each frame after that
+        // Frames are then published one frame later, once the next v-blank is reached or finish_rendering is called
+        // Only used by backends which draw whole lines
+        bool parallel_rendering = false;
+        int render_threads = std::max(1, (int)std::thread::hardware_concurrency());
+        
+        // Stores the decoded LCD registers - updated when the bus flags a write to them
+        gb::lcd_registers lcd = {};
         
         // Stores the current tile as an aray of 256 ints, each representing the value of one pixel
         uint8_t current_tile[64];
@@ -48,16 +153,39 @@ namespace gb {
         
         // Function to initialise to default state
         void init(){
-            // Reset frame buffer to all zeroes
-            for (int x = 0; x < 160; x++){
+            // Defaults to a greyscale host pallette
+            set_host_pallette(0, 255, 255, 255);
+            set_host_pallette(1, 170, 170, 170);
+            set_host_pallette(2, 85, 85, 85);
+            set_host_pallette(3, 0, 0, 0);
+            
+            // Reset all frame buffers to all zeroes, with the RGBA copies in the lightest colour
+            for (int i = 0; i < 3; i++){
+                for (int x = 0; x < 160; x++){
+                    for (int y = 0; y < 144; y++){
+                        frames[i].shades[y][x] = 0;
+                        frames[i].rgba[y * 160 + x] = host_pallette[0];
+                    }
+                }
+                
                 for (int y = 0; y < 144; y++){
-                    frame_buffer[y][x] = 0;
+                    frames[i].row_hashes[y] = gb::hash_row(frames[i].shades[y]);
                 }
             }
             
             // Writes zeroes to SCX and SCY
             write(0xFF00 + gb::regNames::SCX, 0);
             write(0xFF00 + gb::regNames::SCY, 0);
+            
+            // Writes the starting mode and scanline to STAT and LY
+            update_status_registers();
+        }
+        
+        // Function to set the RGB colour used for one of the 4 shades (0 is lightest, 3 is darkest)
+        void set_host_pallette(uint8_t shade, uint8_t r, uint8_t g, uint8_t b){
+            // Bytes are copied so they are in R, G, B, A order in memory regardless of endianness
+            uint8_t bytes[4] = {r, g, b, 255};
+            std::memcpy(&host_pallette[shade], bytes, 4);
         }
         
         
@@ -101,32 +229,57 @@ namespace gb {
             }
         }
         
+        // Function to wait for a frame being drawn in parallel and publish it, eg before pausing emulation
+        void finish_rendering(){
+            finish_frame_render();
+        }
+        
         // Function to do one cycle of emulation
         void do_cycle(){
+            // Decodes the LCD registers again if they have been written to
+            if (bus->update_lcd_registers)
+                decode_lcd_registers();
+            
             // Do nothing if LCDC bit 7 is 0
-            if(gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 7) == 0)
+            if(!lcd.lcd_enabled)
                 return;
             
+            // Stores the mode and scanline before this cycle, so LY and STAT are only updated when they change
+            int old_mode = mode;
+            int old_scanlines = num_scanlines;
+            
             num_cycles += 4;
             
             // Sets current mode depending on number of cycles
             if (num_cycles < 80) {
                 // If entering mode 2, gives an LCDC Status interrupt if bit 5 of STAT is 1
-                if (mode != 2 and gb::Utils::get_bit(get_reg(gb::regNames::STAT), 5))
+                if (mode != 2 and lcd.oam_interrupt)
                     write(0xFF00 + gb::regNames::IF, get_reg(gb::regNames::IF) | 0b00000010);
                 mode = 2; // Mode 2 for 80 cycles
             }
             
-            else if (num_cycles < 252)
-                mode = 3; // Mode 3 for 172 cycles
+            else if (renderer.do_mode3(*this))
+                mode = 3; // Mode 3 for 172 cycles, or longer with the pixel FIFO backend
             
             else if (num_cycles < 456) {
-                // Draws the scanline at the start of h-blank
-                if (mode != 0)
-                    draw_scanline();
+                // Draws the scanline at the start of h-blank, unless this frame is being skipped or in v-blank
+                // When rendering in parallel, the scanline is only recorded, and drawn once v-blank is reached
+                // Backends which draw pixels during mode 3 have already drawn it, so only its hash is needed
+                if (mode != 0 and render_frame and num_scanlines < 144) {
+                    lcd.window_line = window_scanlines;
+                    
+                    if constexpr (!backend::draws_whole_lines)
+                        frames.back().row_hashes[num_scanlines] = gb::hash_row(frames.back().shades[num_scanlines]);
+                    else if (parallel_rendering)
+                        log_scanline();
+                    else {
+                        finish_frame_render();
+                        draw_scanline(num_scanlines, lcd, bus->get_vram(), bus->get_oam(), host_pallette, output_rgba, frames.back());
+                    }
+                }
                 
                 // If entering mode 0, gives an LCDC Status interrupt if bit 3 of STAT is 1
-                if (mode != 0 and gb::Utils::get_bit(get_reg(gb::regNames::STAT), 3))
+                if (mode != 0 and lcd.hblank_interrupt)
                     write(0xFF00 + gb::regNames::IF, get_reg(gb::regNames::IF) | 0b00000010);
                 
                 mode = 0; // Mode 0 for 204 cycles
@@ -134,18 +287,17 @@ namespace gb {
             
             else {
                 // After 456 cycles, the scanline ends - ppu copies graphics and resets the num_cycles counter
-                num_scanlines++;
-                
-                // Increments window scanlines if window is enabled
-                if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 5))
+                // Window scanlines are incremented first if the window was drawn on this scanline
+                if (window_visible())
                     window_scanlines++;
+                num_scanlines++;
                 
                 // If LY = LYC, sets STAT bit 2 and gives an LCDC Status interrupt if bit 6 of STAT is 1
-                bool LY_coincidence = (num_scanlines % 154) == get_reg(gb::regNames::LYC);
+                bool LY_coincidence = (num_scanlines % 154) == lcd.lyc;
                 uint8_t old_status = get_reg(gb::regNames::STAT);
-                write(0xFF00 + gb::regNames::STAT, (old_status & 0b11111011) | LY_coincidence << 2);
+                bus->set_ioreg(gb::regNames::STAT, (old_status & 0b11111011) | LY_coincidence << 2);
                 
-                if (LY_coincidence and gb::Utils::get_bit(get_reg(gb::regNames::STAT), 6))
+                if (LY_coincidence and lcd.lyc_interrupt)
                     write(0xFF00 + gb::regNames::IF, get_reg(gb::regNames::IF) | 0b00000010);
                 
                 num_cycles = 0;
@@ -156,10 +308,20 @@ namespace gb {
             if (num_scanlines > 143) {
                 // Trigger vblank interrupt by setting bit 0 if the IF register when entering V blank
                 if (!vblank) {
+                    // The frame is complete, so it is handed over to the presenter (skipped frames are not)
+                    // When rendering in parallel, the previous frame is published once drawn, and this one starts drawing
+                    finish_frame_render();
+                    if (render_frame) {
+                        if (backend::draws_whole_lines and parallel_rendering)
+                            start_frame_render();
+                        else
+                            frames.publish();
+                    }
+                    
                     write(0xFF00 + gb::regNames::IF, get_reg(gb::regNames::IF) | 0b00000001);
                     
                     // Also gives an LCDC Stauts interrupt if bit 4 of STAT is 1
-                    if (gb::Utils::get_bit(get_reg(gb::regNames::STAT), 4))
+                    if (lcd.vblank_interrupt)
                         write(0xFF00 + gb::regNames::IF, get_reg(gb::regNames::IF) | 0b00000010);
                 }
                 // Mode 1 for the rest of vblank (4560 cycles)
@@ -175,75 +337,251 @@ namespace gb {
                 frame_over = true;
             }
             
-            // Writes status and y position to io registers
-            write(0xFF00 + gb::regNames::LY, num_scanlines);
-
-            // Sets bits 0 and 1 of STAT to the mode
-            uint8_t old_status = get_reg(gb::regNames::STAT);
-            write(0xFF00 + gb::regNames::STAT, (old_status & ~(0b11)) | mode);
+            // Writes status and y position to io registers if they have changed
+            if (mode != old_mode or num_scanlines != old_scanlines)
+                update_status_registers();
         }
         
     private:
         // Stores a pointer to the bus
         gb::bus* bus;
         
-        // 2 vector of 10 OAM indicies to store which sprites are on the current scanline (max 10)
-        std::vector<uint8_t> sprites;
+        // Stores the backend
+        backend renderer;
+        
+        // Stores the RGBA colours of the 4 shades (see set_host_pallette)
+        uint32_t host_pallette[4];
+        
+        // Indices of each pallette in the pallette lookup tables (see draw_scanline)
+        enum {BG_PALLETTE = 0, OBP0_PALLETTE = 4, OBP1_PALLETTE = 8};
+        
+        // Stores everything drawn during one frame when rendering in parallel: the LCD registers at the start of
+        // h-blank on each scanline, and copies of VRAM and OAM - a new copy is only taken when they have been written
+        struct frame_log {
+            bool logged[144] = {};
+            gb::lcd_registers lines[144];
+            int vram_index[144];
+            int oam_index[144];
+            int lines_logged = 0;
+            
+            std::vector<std::array<uint8_t, 0x2000>> vram;
+            std::vector<std::array<uint8_t, 0xA0>> oam;
+            int vram_count = 0;
+            int oam_count = 0;
+            
+            // Host pallette and RGBA setting when the frame was finished
+            uint32_t host_pallette[4];
+            bool output_rgba;
+        };
+        
+        // Two logs - one is filled by the emulation while the other is drawn by the workers
+        frame_log logs[2];
+        int log_index = 0;
+        
+        // Stores the workers drawing the last finished log, and whether they are drawing one - declared after the logs and
+        // frames, so they finish first when destroyed
+        gb::render_workers workers;
+        bool frame_rendering = false;
         
-        // Helper function to get the data for a sprite in OAM
-        uint8_t read_sprite_data(uint8_t sprite_index, uint8_t byte_num){
-            return read(0xFE00 + (4 * sprite_index) + byte_num);
+        // Function to decode the LCD registers into lcd
+        void decode_lcd_registers(){
+            uint8_t lcdc = get_reg(gb::regNames::LCDC);
+            bool was_enabled = lcd.lcd_enabled;
+            lcd.lcd_enabled = gb::Utils::get_bit(lcdc, 7);
+            
+            // Turning the LCD off resets the ppu to the start of a frame, so LY reads 0 and STAT reads mode 0 until
+            // it is turned back on (games wait for mode 0 with the LCD off)
+            if (was_enabled and !lcd.lcd_enabled) {
+                mode = 0;
+                num_cycles = 0;
+                num_scanlines = 0;
+                window_scanlines = 0;
+                vblank = false;
+                update_status_registers();
+            }
+            lcd.window_map = gb::Utils::get_bit(lcdc, 6) ? 0x9C00 : 0x9800;
+            lcd.window_enabled = gb::Utils::get_bit(lcdc, 5);
+            lcd.unsigned_tile_data = gb::Utils::get_bit(lcdc, 4);
+            lcd.background_map = gb::Utils::get_bit(lcdc, 3) ? 0x9C00 : 0x9800;
+            lcd.sprite_height = gb::Utils::get_bit(lcdc, 2) ? 16 : 8;
+            lcd.sprites_enabled = gb::Utils::get_bit(lcdc, 1);
+            lcd.background_enabled = gb::Utils::get_bit(lcdc, 0);
+            
+            uint8_t stat = get_reg(gb::regNames::STAT);
+            lcd.lyc_interrupt = gb::Utils::get_bit(stat, 6);
+            lcd.oam_interrupt = gb::Utils::get_bit(stat, 5);
+            lcd.vblank_interrupt = gb::Utils::get_bit(stat, 4);
+            lcd.hblank_interrupt = gb::Utils::get_bit(stat, 3);
+            
+            lcd.scy = get_reg(gb::regNames::SCY);
+            lcd.scx = get_reg(gb::regNames::SCX);
+            lcd.lyc = get_reg(gb::regNames::LYC);
+            lcd.bgp = get_reg(gb::regNames::BGP);
+            lcd.obp0 = get_reg(gb::regNames::OBP0);
+            lcd.obp1 = get_reg(gb::regNames::OBP1);
+            lcd.wy = get_reg(gb::regNames::WY);
+            lcd.wx = get_reg(gb::regNames::WX);
+            
+            bus->update_lcd_registers = false;
+        }
+        
+        // Function to check whether the window is drawn on the current scanline
+        bool window_visible(){
+            return lcd.background_enabled and lcd.window_enabled and num_scanlines < 144 and num_scanlines >= lcd.wy and lcd.wx < 167;
+        }
+        
+        // Function to write the scanline to LY and the mode to bits 0 and 1 of STAT
+        // These are set directly, so they do not go through the bus or flag the LCD registers as changed
+        void update_status_registers(){
+            bus->set_ioreg(gb::regNames::LY, num_scanlines);
+            
+            uint8_t old_status = get_reg(gb::regNames::STAT);
+            bus->set_ioreg(gb::regNames::STAT, (old_status & ~(0b11)) | mode);
+        }
+        
+        // Function to record the current scanline into the frame log, instead of drawing it
+        void log_scanline(){
+            frame_log& log = logs[log_index];
+            
+            // The first scanline of each frame always takes new copies of VRAM and OAM
+            if (log.lines_logged == 0) {
+                log.vram_count = 0;
+                log.oam_count = 0;
+                bus->vram_written = true;
+                bus->oam_written = true;
+            }
+            
+            if (bus->vram_written) {
+                if (log.vram_count == (int)log.vram.size())
+                    log.vram.emplace_back();
+                std::memcpy(log.vram[log.vram_count++].data(), bus->get_vram(), 0x2000);
+                bus->vram_written = false;
+            }
+            
+            if (bus->oam_written) {
+                if (log.oam_count == (int)log.oam.size())
+                    log.oam.emplace_back();
+                std::memcpy(log.oam[log.oam_count++].data(), bus->get_oam(), 0xA0);
+                bus->oam_written = false;
+            }
+            
+            log.logged[num_scanlines] = true;
+            log.lines[num_scanlines] = lcd;
+            log.vram_index[num_scanlines] = log.vram_count - 1;
+            log.oam_index[num_scanlines] = log.oam_count - 1;
+            log.lines_logged++;
         }
-
         
-        // Function to draw one scnaline of graphics
-        void draw_scanline(){
-            // Do nothing if in vblank
-            if (num_scanlines > 143)
+        // Function to start drawing the frame log into the back frame on worker threads, and start a new log
+        void start_frame_render(){
+            frame_log* log = &logs[log_index];
+            std::memcpy(log->host_pallette, host_pallette, sizeof(host_pallette));
+            log->output_rgba = output_rgba;
+            
+            // Each worker draws a block of scanlines
+            gb::frame* target = &frames.back();
+            int num_threads = std::max(1, std::min(render_threads, 144));
+            
+            workers.start(num_threads, [log, target](int worker, int num_workers){
+                int first_line = 144 * worker / num_workers;
+                int last_line = 144 * (worker + 1) / num_workers;
+                
+                for (int y = first_line; y < last_line; y++){
+                    if (log->logged[y])
+                        draw_scanline(y, log->lines[y], log->vram[log->vram_index[y]].data(), log->oam[log->oam_index[y]].data(),
+                                      log->host_pallette, log->output_rgba, *target);
+                }
+            });
+            frame_rendering = true;
+            
+            // Starts the next frame's log in the other buffer
+            log_index = 1 - log_index;
+            std::fill(std::begin(logs[log_index].logged), std::end(logs[log_index].logged), false);
+            logs[log_index].lines_logged = 0;
+        }
+        
+        // Function to wait for the workers drawing the last frame log and publish the frame - does nothing if none are running
+        void finish_frame_render(){
+            if (!frame_rendering)
                 return;
             
-            // Othwerise, fetch which sprites are on this scanline
-            sprites.clear();
+            workers.wait();
+            frame_rendering = false;
+            
+            frames.publish();
+        }
+        
+    public:
+        // Function to draw one scanline of graphics into a frame, from the LCD registers and the contents of VRAM and OAM
+        // It only reads its arguments, so it can be used for the live scanline or from a frame log on any thread
+        static void draw_scanline(int y, const gb::lcd_registers& regs, const uint8_t* vram, const uint8_t* oam,
+                                  const uint32_t* host_pallette, bool output_rgba, gb::frame& frame){
+            // Fetch which sprites are on this scanline (max 10)
+            uint8_t sprites[10];
+            int num_sprites = 0;
             
             for (int sprite_num = 0; sprite_num < 40; sprite_num++){
                 // If the scanline number is between the sprite's y base and the sprite's y position - 16 then it is visible
                 // Y position is sprite's top left corner + 16
                 // Sprite height is read from LCDC bit 2 (0 = 8x8, 1 = 8x16)
                 
-                int dy = read_sprite_data(sprite_num, 0) - num_scanlines;
-                int dy_min = gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 2) ? 0: 8;
+                int dy = oam[4 * sprite_num] - y;
+                int dy_min = 16 - regs.sprite_height;
                 if (dy > dy_min and dy <= 16) {
-                    // Add sprite to the vector of sprites
-                    sprites.push_back(sprite_num);
+                    // Add sprite to the array of sprites
+                    sprites[num_sprites++] = sprite_num;
                 }
                 
                 // If there are 10 sprites, break from the loop
-                if (sprites.size() >= 10)
-                    goto end;
+                if (num_sprites >= 10)
+                    break;
             }
-        end:
+            
             // Sorts the sprites if there are any
-            if (sprites.size() > 0)
-                sort_sprites();
+            if (num_sprites > 0)
+                sort_sprites(sprites, num_sprites, oam);
+            
+            // Builds lookup tables for the BGP, OBP0 and OBP1 pallettes, indexed by 4 * pallette + pixel value (see draw_pixel)
+            // Shades are used for frame.shades and colours for frame.rgba
+            // Each pallette stores 2 bit colours for each of the pixel values 0-3, with the value for 0 in bits 1-0
+            uint8_t shade_lut[12];
+            uint32_t rgba_lut[12];
+            for (uint8_t pixel_data = 0; pixel_data < 4; pixel_data++){
+                shade_lut[BG_PALLETTE + pixel_data] = (regs.bgp >> (pixel_data * 2)) & 0b11;
+                shade_lut[OBP0_PALLETTE + pixel_data] = (regs.obp0 >> (pixel_data * 2)) & 0b11;
+                shade_lut[OBP1_PALLETTE + pixel_data] = (regs.obp1 >> (pixel_data * 2)) & 0b11;
+            }
+            
+            for (int i = 0; i < 12; i++){
+                rgba_lut[i] = host_pallette[shade_lut[i]];
+            }
         
-            // Render all 160 pixels
+            // Render all 160 pixels into the frame, resolving them through the lookup tables
+            uint8_t* shade_row = frame.shades[y];
+            uint32_t* rgba_row = &frame.rgba[160 * y];
             for (int x = 0; x < 160; x++){
-                frame_buffer[num_scanlines][x] = draw_pixel(x);
+                uint8_t lut_index = draw_pixel(x, y, regs, vram, oam, sprites, num_sprites);
+                shade_row[x] = shade_lut[lut_index];
+                
+                if (output_rgba)
+                    rgba_row[x] = rgba_lut[lut_index];
             }
+            
+            frame.row_hashes[y] = gb::hash_row(shade_row);
         }
-    
         
+    private:
         // Function which sorts sprite priorities on the same scalnine
-        void sort_sprites(){
+        static void sort_sprites(uint8_t* sprites, int num_sprites, const uint8_t* oam){
             // Repeats for the number of elements in sprites
-            for (int i = 0; i < sprites.size(); i++) {
+            for (int i = 0; i < num_sprites; i++) {
                 // Finds the highest priority sprite after index i
                 int min_value = 0x100;
                 int min_index = 0;
                 
-                for (int j = i; j < sprites.size(); j++) {
+                for (int j = i; j < num_sprites; j++) {
                     // Sprites with smaller x coordinate come first
-                    int current_value = read_sprite_data(sprites[j], 1);
+                    int current_value = oam[4 * sprites[j] + 1];
                     
                     // If current value is less than min_value, set min_value to current_value and store current index
                     if (current_value < min_value) {
@@ -258,64 +596,65 @@ namespace gb {
             }
         }
         
-        // Fucntion to render a single pixel at a given x position, using the stored scanline number
-        uint8_t draw_pixel(int x){
+        // Fucntion to render a single pixel at a given position
+        // Returns the index of the pixel in the pallette lookup tables (4 * pallette + pixel value)
+        static uint8_t draw_pixel(int x, int y, const gb::lcd_registers& regs, const uint8_t* vram, const uint8_t* oam,
+                                  const uint8_t* sprites, int num_sprites){
             // Gets the values of the background, window and sprite pixels at this position
-            uint8_t background_pixel = get_background_pixel_data(x, num_scanlines);
-            int window_pixel = get_window_pixel_data(x, num_scanlines);
-            auto [sprite_pixel, sprite_priority, sprite_pallette] = get_sprite_pixel_data(x, num_scanlines);
+            uint8_t background_pixel = get_background_pixel_data(x, y, regs, vram);
+            int window_pixel = get_window_pixel_data(x, y, regs, vram);
+            auto [sprite_pixel, sprite_priority, sprite_pallette] = get_sprite_pixel_data(x, y, regs, vram, oam, sprites, num_sprites);
             
             // Return correct pixel based on priorities
             if (sprite_pixel == 0)
                 // Return background/window pixel if sprite pixel is zero, ie transparent
-                return get_background_pallette_data((window_pixel == -1) ? background_pixel : window_pixel);
+                return BG_PALLETTE + ((window_pixel == -1) ? background_pixel : window_pixel);
 
             if (sprite_priority and background_pixel != 0)
                 // If sprite priotity is 1, and background pixel is not 0, return background/window pxiel
-                return get_background_pallette_data((window_pixel == -1) ? background_pixel : window_pixel);
+                return BG_PALLETTE + ((window_pixel == -1) ? background_pixel : window_pixel);
             
             // Othwerise, return sprite pixel
-            return get_sprite_pallette_data(sprite_pixel, sprite_pallette);
+            return (sprite_pallette ? OBP1_PALLETTE : OBP0_PALLETTE) + sprite_pixel;
         }
         
         // Gets the value of the sprite pixel at this location (0 is no sprite or transparent), its BG priority and its pallette
-        std::tuple<uint8_t, bool, bool> get_sprite_pixel_data(int x, int y){
+        static std::tuple<uint8_t, bool, bool> get_sprite_pixel_data(int x, int y, const gb::lcd_registers& regs, const uint8_t* vram,
+                                                                     const uint8_t* oam, const uint8_t* sprites, int num_sprites){
             // If sprites are disabled (LCDC bit 1 = 0), then return a transparent pixel (value 0)
-            if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 1) == 0)
+            if (!regs.sprites_enabled)
                 return std::make_tuple(0, 0, 0);
             
             // Loops through all sprites on this scanline in priprity order
-            for (auto sprite_index:sprites){
+            for (int i = 0; i < num_sprites; i++){
+                const uint8_t* sprite = &oam[4 * sprites[i]];
+                
                 // Checks if current x is between sprite x and sprite x - 8
-                int dx = read_sprite_data(sprite_index, 1) - x;
+                int dx = sprite[1] - x;
                 
                 if (dx > 0 and dx <= 8){
                     // If this sprite is visible...
-                    int sprite_height = gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 2) ? 16 : 8;
-                    uint8_t flags_byte = read_sprite_data(sprite_index, 3);
+                    int sprite_height = regs.sprite_height;
+                    uint8_t flags_byte = sprite[3];
                     
                     // Calculates the position within the tile to use
-                    int fine_x = x - (read_sprite_data(sprite_index, 1) - 8);
-                    int fine_y = y - (read_sprite_data(sprite_index, 0) - 16);
+                    int fine_x = x - (sprite[1] - 8);
+                    int fine_y = y - (sprite[0] - 16);
                     
                     // Flips y if flags bit 6 is set, and x if flags bit 5 is set
                     fine_x = gb::Utils::get_bit(flags_byte, 5) ? 7 - fine_x : fine_x;
                     fine_y = gb::Utils::get_bit(flags_byte, 6) ? (sprite_height - 1) - fine_y : fine_y;
                     
-                    // 8x8 sprites
-                    if (sprite_height == 8) {
-                        // Get the tile data for the sprite
-                        uint8_t tile_index = read_sprite_data(sprite_index, 2);
-                        get_tile_data(tile_index);
-                        
-                    // 8x16 sprites
-                    } else if (sprite_height == 16) {
-                        //Get the tile data
-                        uint8_t tile_index = read_sprite_data(sprite_index, 2) & 0xFE;
-                        get_tile_data(fine_y > 7 ? tile_index + 1 : tile_index);
-                    }
+                    // Gets the tile for the sprite - 8x16 sprites use the tile pair starting at an even index
+                    int tile_index = sprite[2];
+                    if (sprite_height == 16)
+                        tile_index = (fine_y > 7) ? (tile_index & 0xFE) + 1 : tile_index & 0xFE;
                     
-                    uint8_t pixel_data = current_tile[8 * (fine_y % 8) + fine_x];
+                    // Gets the two bytes for the row, from the tile data at 8000 - each tile is 16 bytes
+                    uint8_t pixel_low = vram[16 * tile_index + 2 * (fine_y % 8)];
+                    uint8_t pixel_high = vram[16 * tile_index + 2 * (fine_y % 8) + 1];
+                    
+                    uint8_t pixel_data = gb::Utils::get_bit(pixel_low, (7 - fine_x)) + 2 * gb::Utils::get_bit(pixel_high, (7 - fine_x));
                     
                     // If the pixel is not 0 (ie not transparent)...
                     if (pixel_data != 0) {
@@ -330,29 +669,27 @@ namespace gb {
         }
         
         // Gets the value of the background pixel at this location
-        uint8_t get_background_pixel_data(int x, int y){
+        static uint8_t get_background_pixel_data(int x, int y, const gb::lcd_registers& regs, const uint8_t* vram){
             // If background rendering is disabled (LCDC bit 0 = 0), then return 0
-            if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 0) == 0)
+            if (!regs.background_enabled)
                 return 0;
             
             // Calculates tile position and fine position (position within tile from 0-7)
-            int scrolled_x = (x + get_reg(gb::regNames::SCX)) % 256;
-            int scrolled_y = (y + get_reg(gb::regNames::SCY)) % 256;
+            int scrolled_x = (x + regs.scx) % 256;
+            int scrolled_y = (y + regs.scy) % 256;
             
             int tile_x = scrolled_x / 8; int tile_y = scrolled_y / 8;
             int fine_x = scrolled_x % 8; int fine_y = scrolled_y % 8;
             
             // Gets the tile index from the tile table in VRAM (9800 - 9BFF or 9C00 - 9FFF depending on LCDC bit 3)
-            uint16_t nametable_base = gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 3) ? 0x9C00 : 0x9800;
-            uint8_t tile_index = read(nametable_base + tile_x + 32 * tile_y);
+            uint8_t tile_index = vram[regs.background_map - 0x8000 + tile_x + 32 * tile_y];
             
-            // Calculates the address of that tile
-            uint16_t tile_addr = get_address_of_background_tile(tile_index);
-            // uint16_t tile_addr = 0x8000 + 16 * tile_index;
+            // Calculates the position of that tile in VRAM
+            int tile_offset = get_background_tile_offset(tile_index, regs);
             
             // Gets the two bytes for the current pixel
-            uint8_t pixel_low = read(tile_addr + 2 * fine_y);
-            uint8_t pixel_high = read(tile_addr + 2 * fine_y + 1);
+            uint8_t pixel_low = vram[tile_offset + 2 * fine_y];
+            uint8_t pixel_high = vram[tile_offset + 2 * fine_y + 1];
             
             // Gets the actual pixel data
             uint8_t pixel_data = gb::Utils::get_bit(pixel_low, (7 - fine_x)) + 2 * gb::Utils::get_bit(pixel_high, (7 - fine_x));
@@ -360,50 +697,50 @@ namespace gb {
         }
         
         // Gets the value of the window pixel at this location
-        int get_window_pixel_data(int x, int y){
+        static int get_window_pixel_data(int x, int y, const gb::lcd_registers& regs, const uint8_t* vram){
             // If background/window rendering is disabled (LCDC bit 0 = 0), then return -1 for no pixel
-            if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 0) == 0)
+            if (!regs.background_enabled)
                 return -1;
             
             // If window rendering is disabled (LCDC bit 5 == 0), then return -1 for no pixel
-            if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 5) == 0)
+            if (!regs.window_enabled)
                 return -1;
             
             // If this pixel is not in the window display area, return -1 for no pixel
-            if (x < (get_reg(gb::regNames::WX) - 7) or y < get_reg(gb::regNames::WY))
+            if (x < (regs.wx - 7) or y < regs.wy)
                 return -1;
             
-            // Calculates tile position and fine position (position within tile from 0-7)
-            int scrolled_x = (x + 7 - get_reg(gb::regNames::WX));
-            int scrolled_y = (y - get_reg(gb::regNames::WY));
+            // Calculates tile position and fine position (position within tile from 0-7) - the window's rows are counted by
+            // its own line counter, so it carries on from where it stopped if it is hidden for some scanlines
+            int scrolled_x = (x + 7 - regs.wx);
+            int scrolled_y = regs.window_line;
             
             int tile_x = scrolled_x / 8; int tile_y = scrolled_y / 8;
             int fine_x = scrolled_x % 8; int fine_y = scrolled_y % 8;
             
             // Gets the tile index from the tile table in VRAM (9800 - 9BFF or 9C00 - 9FFF depending on LCDC bit 6)
-            uint16_t nametable_base = gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 6) ? 0x9C00 : 0x9800;
-            uint8_t tile_index = read(nametable_base + tile_x + 32 * tile_y);
+            uint8_t tile_index = vram[regs.window_map - 0x8000 + tile_x + 32 * tile_y];
             
-            // Calculates the address of that tile
-            uint16_t tile_addr = get_address_of_background_tile(tile_index);
+            // Calculates the position of that tile in VRAM
+            int tile_offset = get_background_tile_offset(tile_index, regs);
             
             // Gets the two bytes for the current pixel
-            uint8_t pixel_low = read(tile_addr + 2 * fine_y);
-            uint8_t pixel_high = read(tile_addr + 2 * fine_y + 1);
+            uint8_t pixel_low = vram[tile_offset + 2 * fine_y];
+            uint8_t pixel_high = vram[tile_offset + 2 * fine_y + 1];
             
             // Gets the actual pixel data
             uint8_t pixel_data = gb::Utils::get_bit(pixel_low, (7 - fine_x)) + 2 * gb::Utils::get_bit(pixel_high, (7 - fine_x));
             return pixel_data;
         }
         
-        // Function to translate a 1 byte tile address into an index into VRAM
-        uint16_t get_address_of_background_tile(uint8_t tile_index) {
-            if (gb::Utils::get_bit(get_reg(gb::regNames::LCDC), 4))
+        // Function to translate a 1 byte tile address into a position in VRAM (address - 8000)
+        static int get_background_tile_offset(uint8_t tile_index, const gb::lcd_registers& regs) {
+            if (regs.unsigned_tile_data)
                 // If LCDC bit 4 is 1, tiles are read from 0x8000 - each tile is 16 bits
-                return 0x8000 + 16 * tile_index;
+                return 16 * tile_index;
             else
                 // IF LCDC bit 4 is 0, indicies 0-127 are read from 0x9000, and indicies 128-255 are read from 0x8800 - each tile is 16 bits
-                return (tile_index > 0x7F) ? 0x8000 + 16 * tile_index : 0x9000 + 16 * tile_index;
+                return (tile_index > 0x7F) ? 16 * tile_index : 0x1000 + 16 * tile_index;
         }
         
         // Basic functions to read/write data to/from the bus
@@ -419,6 +756,8 @@ namespace gb {
             return bus->get_ioreg(reg_num);
         }
     };
+    
+    typedef ppu_core<gb::scanline_backend> ppu;
 }
 
 #endif /* ppu_h */